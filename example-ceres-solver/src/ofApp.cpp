@@ -4,40 +4,6 @@
 
 #include "ofMain.h"
 
-struct RigidBodyTransformError {
-    RigidBodyTransformError(const glm::tvec3<double> & untransformedPoint, const glm::tvec3<double> & transformedPoint)
-    : untransformedPoint(untransformedPoint)
-    , transformedPoint(transformedPoint) {}
-    
-    template <typename T>
-    bool operator()(const T * const transformParameters
-                    , T * residuals) const {
-        
-        glm::tvec3<T> translation(transformParameters[0], transformParameters[1], transformParameters[2]);
-        glm::tvec3<T> rotationVector(transformParameters[3], transformParameters[4], transformParameters[5]);
-        
-        auto transform = ofxCeresSolver::VectorMath::createTransform(translation, rotationVector);
-        auto predictedTransformedPoint = transform * glm::tvec4<T>(this->untransformedPoint, 1.0);
-        
-        predictedTransformedPoint /= predictedTransformedPoint.w;
-        
-        for (int i = 0; i < 3; i++) {
-            residuals[i] = this->transformedPoint[i] - predictedTransformedPoint[i];
-        }
-        
-        return true;
-    }
-    
-    static ceres::CostFunction * Create(const glm::tvec3<double> & untransformedPoint, const glm::tvec3<double> & transformedPoint) {
-        return (new ceres::AutoDiffCostFunction<RigidBodyTransformError, 3, 6>(
-                                                                               new RigidBodyTransformError(untransformedPoint, transformedPoint)));
-    }
-    
-    glm::tvec3<double> untransformedPoint;
-    glm::tvec3<double> transformedPoint;
-};
-
-
 class ofApp : public ofBaseApp{
     vector<glm::vec3> untransformedPoints;
     vector<glm::vec3> transformedPoints;
@@ -96,7 +62,7 @@ public:
         ceres::Problem problem;
         size_t size = untransformedPoints.size();
         for (size_t i = 0; i < size; i++) {
-            ceres::CostFunction * costFunction = RigidBodyTransformError::Create(untransformedPoints[i], transformedPoints[i]);
+            ceres::CostFunction * costFunction = ofxCeresSolver::RigidBodyTransformError::Create(untransformedPoints[i], transformedPoints[i]);
             problem.AddResidualBlock(costFunction
                                      , NULL
                                      , parameters);
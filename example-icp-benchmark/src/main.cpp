@@ -0,0 +1,163 @@
+// Headless ICP benchmark on a synthetic cloud. Times the work of one ICP
+// iteration stage by stage (transforming the source, the KdTree correspondence
+// search, creating the residual blocks and evaluating them with Jacobians),
+// then full ICP::solve calls warm started as between camera frames.
+// usage : example-icp-benchmark [point count]
+// (default 50000)
+#include "ofxCeresSolver.h"
+
+#include "ofMain.h"
+
+#include <chrono>
+#include <limits>
+#include <random>
+
+//----------
+// Fastest of the passes, in msec. The fastest pass is the least disturbed by other processes.
+template<typename Function>
+static double timeFastest(int passes, const Function & function) {
+    double fastest = std::numeric_limits<double>::max();
+    function();
+    for (int i = 0; i < passes; i++) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        function();
+        auto t1 = std::chrono::high_resolution_clock::now();
+        fastest = std::min(fastest, std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    return fastest;
+}
+
+//----------
+// A wavy sheet, so point to plane has a well defined normal everywhere
+static vector<glm::vec3> makeCloud(size_t count, std::mt19937 & random) {
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    vector<glm::vec3> points;
+    points.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const float x = uniform(random);
+        const float y = uniform(random);
+        points.push_back(glm::vec3(x, y, 0.1f * sin(4.0f * x) * cos(3.0f * y)));
+    }
+    return points;
+}
+
+//----------
+static void runIterationStages(const vector<glm::vec3> & reference
+    , const vector<glm::vec3> & source
+    , bool pointToPlane) {
+    auto & threadPool = ofxCeresSolver::ThreadPool::getShared();
+
+    ofxCeresSolver::KdTree tree;
+    tree.build(reference);
+    vector<glm::vec3> normals;
+    if (pointToPlane) {
+        ofxCeresSolver::ICP::estimateNormals(reference, tree, 8, normals);
+    }
+
+    double parameters[6] = { 0.01, -0.01, 0.0, 0.01, 0.0, -0.01 };
+    ofxCeresSolver::SharedTransformCache transformCache;
+    const auto & cachedTransform = transformCache.add(parameters);
+
+    vector<glm::vec3> transformed(source.size());
+    vector<ofxCeresSolver::KdTree::Result> matches;
+    const auto transform = glm::mat4(ofxCeresSolver::ICP::getTransform(parameters));
+    const float maxDistance2 = 0.05f * 0.05f;
+
+    const double searchTime = timeFastest(20, [&]() {
+        threadPool.parallelFor(source.size(), [&](size_t i) {
+            transformed[i] = glm::vec3(transform * glm::vec4(source[i], 1.0f));
+        });
+        tree.findNearest(transformed, matches, maxDistance2, threadPool);
+    });
+
+    std::vector<std::unique_ptr<ceres::CostFunction>> costFunctions;
+    auto create = [&]() {
+        costFunctions.clear();
+        for (size_t i = 0; i < source.size(); i++) {
+            const auto & match = matches[i];
+            if (match.index == ofxCeresSolver::KdTree::NotFound) {
+                continue;
+            }
+            if (pointToPlane) {
+                costFunctions.emplace_back(ofxCeresSolver::CachedPointToPlaneTransformError::Create(cachedTransform
+                    , source[i]
+                    , reference[match.index]
+                    , normals[match.index]));
+            }
+            else {
+                costFunctions.emplace_back(ofxCeresSolver::CachedRigidBodyTransformError::Create(cachedTransform
+                    , source[i]
+                    , reference[match.index]));
+            }
+        }
+    };
+    const double createTime = timeFastest(20, create);
+
+    // one residual evaluation and one Jacobian evaluation, as in each solver iteration
+    const int residualCount = costFunctions.empty() ? 0 : costFunctions.front()->num_residuals();
+    vector<double> residuals(costFunctions.size() * residualCount);
+    vector<double> jacobian(residuals.size() * 6);
+    const double * parameterBlocks[1] = { parameters };
+    const double evaluateTime = timeFastest(20, [&]() {
+        transformCache.PrepareForEvaluation(true, true);
+        for (size_t i = 0; i < costFunctions.size(); i++) {
+            double * jacobians[1] = { jacobian.data() + i * residualCount * 6 };
+            costFunctions[i]->Evaluate(parameterBlocks, residuals.data() + i * residualCount, jacobians);
+        }
+        for (size_t i = 0; i < costFunctions.size(); i++) {
+            costFunctions[i]->Evaluate(parameterBlocks, residuals.data() + i * residualCount, NULL);
+        }
+    });
+
+    const double total = searchTime + createTime + evaluateTime;
+    cout << (pointToPlane ? "point to plane" : "point to point") << ", " << costFunctions.size() << " correspondences" << endl;
+    cout << "  transform and correspondence search : " << searchTime << "msec" << endl;
+    cout << "  create residual blocks : " << createTime << "msec" << endl;
+    cout << "  evaluate residuals and Jacobians : " << evaluateTime << "msec" << endl;
+    cout << "  per iteration, without the linear solve : " << total << "msec, "
+        << (1000.0 / 30.0) / total << " of these fit in a 30Hz frame" << endl;
+}
+
+//----------
+static void runSolves(const vector<glm::vec3> & reference
+    , const vector<glm::vec3> & source
+    , bool pointToPlane) {
+    ofxCeresSolver::ICP icp;
+    auto settings = icp.getSettings();
+    settings.pointToPlane = pointToPlane;
+    settings.maxCorrespondenceDistance = 0.05f;
+    icp.setSettings(settings);
+    icp.setReference(reference);
+
+    // the first frame is a cold start, later frames warm start from the previous result
+    for (int frame = 0; frame < 5; frame++) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        const auto result = icp.solve(source);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        cout << "  frame " << frame << " : " << std::chrono::duration<double, std::milli>(t1 - t0).count() << "msec, "
+            << result.iterations << " iterations, rms " << result.rmsError << endl;
+    }
+}
+
+//========================================================================
+int main(int argc, char ** argv) {
+    const size_t count = argc > 1 ? (size_t) std::max(16, atoi(argv[1])) : 50000;
+
+    std::mt19937 random(0);
+    const auto reference = makeCloud(count, random);
+
+    // a second scan of the same surface, moved slightly as between frames
+    std::normal_distribution<float> noise(0.0f, 0.002f);
+    const auto motion = ofxCeresSolver::VectorMath::createTransform(glm::vec3(0.02f, -0.01f, 0.01f), glm::vec3(0.02f, -0.01f, 0.03f));
+    vector<glm::vec3> source;
+    for (const auto & point : makeCloud(count, random)) {
+        source.push_back(glm::vec3(motion * glm::vec4(point, 1.0f)) + glm::vec3(noise(random), noise(random), noise(random)));
+    }
+
+    cout << count << " points, " << ofxCeresSolver::ThreadPool::getShared().getNumThreads() << " threads" << endl;
+    for (bool pointToPlane : { false, true }) {
+        runIterationStages(reference, source, pointToPlane);
+        runSolves(reference, source, pointToPlane);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Headless PoseGraph benchmark over the synthetic sphere and torus datasets.
+// usage : example-pose-graph-benchmark [pose count ...]
+// (default 10000 30000 100000), or with a g2o file to solve that instead
+// usage : example-pose-graph-benchmark <file.g2o> [output.g2o] [--spanning-tree]
+// The file's poses are the initial guess unless --spanning-tree replaces them
+// with the spanning tree over the measurements (for files without poses).
+#include "ofxCeresSolver.h"
+
+#include "ofMain.h"
+
+#include <chrono>
+
+//----------
+static int solveFile(const std::string & path, const std::string & outputPath, bool spanningTree) {
+    ofxCeresSolver::PoseGraph graph;
+    if (!graph.loadG2O(path)) {
+        cerr << "could not load " << path << endl;
+        return 1;
+    }
+    cout << graph.getPoses().size() << " poses, " << graph.getConstraints().size() << " constraints" << endl;
+    if (spanningTree) {
+        graph.initializeFromSpanningTree();
+    }
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    auto summary = graph.solve();
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    cout << summary.FullReport() << endl;
+    cout << "solve " << std::chrono::duration<double, std::milli>(t1 - t0).count() << "msec" << endl;
+    if (!outputPath.empty() && !graph.saveG2O(outputPath)) {
+        cerr << "could not save " << outputPath << endl;
+        return 1;
+    }
+    return 0;
+}
+
+//========================================================================
+int main(int argc, char ** argv) {
+    if (argc > 1 && std::string(argv[1]).find(".g2o") != std::string::npos) {
+        std::string outputPath;
+        bool spanningTree = false;
+        for (int i = 2; i < argc; i++) {
+            if (std::string(argv[i]) == "--spanning-tree") {
+                spanningTree = true;
+            }
+            else {
+                outputPath = argv[i];
+            }
+        }
+        return solveFile(argv[1], outputPath, spanningTree);
+    }
+
+    std::vector<int> poseCounts;
+    for (int i = 1; i < argc; i++) {
+        poseCounts.push_back(std::max(4, atoi(argv[i])));
+    }
+    if (poseCounts.empty()) {
+        poseCounts = { 10000, 30000, 100000 };
+    }
+
+    const auto results = ofxCeresSolver::PoseGraph::runBenchmark(poseCounts);
+    cout << ofxCeresSolver::PoseGraph::getBenchmarkReport(results);
+    return 0;
+}
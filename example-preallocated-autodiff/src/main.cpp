@@ -0,0 +1,137 @@
+// Headless check that PreallocatedAutoDiffCostFunction::Evaluate does not allocate.
+// Global operator new is replaced with a counting one, the cost function is
+// evaluated with Jacobians (once to warm up, then repeatedly) and the count of
+// allocations during the repeated evaluations must be 0. Exits with 1 otherwise.
+// ceres::DynamicAutoDiffCostFunction is counted the same way for comparison.
+// usage : example-preallocated-autodiff [evaluation count]
+#include "ofxCeresSolver.h"
+
+#include "ofMain.h"
+
+#include <ceres/dynamic_autodiff_cost_function.h>
+#include <ceres/rotation.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// the replacements below pair malloc with free, which GCC can not see through
+// once they are inlined into ceres' own new / delete pairs
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<size_t> allocationCount(0);
+
+//----------
+void * operator new(std::size_t size) {
+    allocationCount++;
+    if (void * pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+//----------
+void * operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+//----------
+void operator delete(void * pointer) noexcept {
+    std::free(pointer);
+}
+
+//----------
+void operator delete[](void * pointer) noexcept {
+    operator delete(pointer);
+}
+
+//----------
+void operator delete(void * pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+//----------
+void operator delete[](void * pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+//----------
+// End of a chain of 3 links, each rotated by the euler angles of its own
+// parameter block, against a target position
+struct ChainError {
+    template<typename T>
+    bool operator()(T const * const * parameters, T * residuals) const {
+        T position[3] = { T(0.0), T(0.0), T(0.0) };
+        T direction[3] = { T(0.0), T(1.0), T(0.0) };
+        for (int link = 0; link < 3; link++) {
+            const T * angles = parameters[link];
+            T rotated[3];
+            T matrix[9];
+            ceres::EulerAnglesToRotationMatrix(angles, 3, matrix);
+            for (int row = 0; row < 3; row++) {
+                rotated[row] = matrix[row * 3 + 0] * direction[0]
+                    + matrix[row * 3 + 1] * direction[1]
+                    + matrix[row * 3 + 2] * direction[2];
+            }
+            for (int i = 0; i < 3; i++) {
+                direction[i] = rotated[i];
+                position[i] += direction[i];
+            }
+        }
+        residuals[0] = position[0] - 0.5;
+        residuals[1] = position[1] - 2.0;
+        residuals[2] = position[2] - 0.5;
+        return true;
+    }
+};
+
+//----------
+// Allocations during count evaluations with Jacobians, after one warm up evaluation
+static size_t countAllocations(const ceres::CostFunction & costFunction, int count) {
+    double angles[3][3] = { { 1.0, 2.0, 3.0 }, { 4.0, 5.0, 6.0 }, { 7.0, 8.0, 9.0 } };
+    const double * parameters[3] = { angles[0], angles[1], angles[2] };
+    double residuals[3];
+    double jacobianStorage[3][9];
+    double * jacobians[3] = { jacobianStorage[0], jacobianStorage[1], jacobianStorage[2] };
+
+    costFunction.Evaluate(parameters, residuals, jacobians);
+
+    const size_t before = allocationCount.load();
+    for (int i = 0; i < count; i++) {
+        angles[i % 3][i % 2] += 1e-3;
+        costFunction.Evaluate(parameters, residuals, jacobians);
+    }
+    return allocationCount.load() - before;
+}
+
+//========================================================================
+int main(int argc, char ** argv) {
+    const int count = argc > 1 ? std::max(1, atoi(argv[1])) : 10000;
+
+    ofxCeresSolver::PreallocatedAutoDiffCostFunction<ChainError> preallocated(new ChainError()
+        , { 3, 3, 3 }
+        , 3
+        , 1);
+
+    ceres::DynamicAutoDiffCostFunction<ChainError, 4> dynamic(new ChainError());
+    for (int i = 0; i < 3; i++) {
+        dynamic.AddParameterBlock(3);
+    }
+    dynamic.SetNumResiduals(3);
+
+    const auto preallocatedAllocations = countAllocations(preallocated, count);
+    const auto dynamicAllocations = countAllocations(dynamic, count);
+
+    cout << "allocations over " << count << " evaluations with Jacobians" << endl;
+    cout << "PreallocatedAutoDiffCostFunction : " << preallocatedAllocations << endl;
+    cout << "DynamicAutoDiffCostFunction : " << dynamicAllocations << endl;
+
+    if (preallocatedAllocations != 0) {
+        cerr << "FAILED : PreallocatedAutoDiffCostFunction allocated during Evaluate" << endl;
+        return 1;
+    }
+    cout << "OK" << endl;
+    return 0;
+}
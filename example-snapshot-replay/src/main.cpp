@@ -0,0 +1,56 @@
+// Headless replay of a solve captured with ofxCeresSolver::Snapshot.
+// usage : example-snapshot-replay <file.snapshot> [repeat count]
+#include "ofxCeresSolver.h"
+
+#include "ofMain.h"
+
+#include <chrono>
+
+//========================================================================
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        cerr << "usage : " << argv[0] << " <file.snapshot> [repeat count]" << endl;
+        return 1;
+    }
+    const int repeatCount = argc > 2 ? std::max(1, atoi(argv[2])) : 1;
+    
+    ofxCeresSolver::Snapshot::Reader reader;
+    if (!reader.open(argv[1])) {
+        cerr << "could not open snapshot " << argv[1] << endl;
+        return 1;
+    }
+    cout << reader.getCorrespondenceCount() << " correspondences" << endl;
+    
+    auto options = reader.getSolverOptions();
+    
+    double buildTime = 0.0;
+    double solveTime = 0.0;
+    ceres::Solver::Summary summary;
+    double parameters[6];
+    
+    for (int i = 0; i < repeatCount; i++) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        
+        ceres::Problem problem;
+        reader.buildProblem(problem, parameters);
+        
+        auto t1 = std::chrono::high_resolution_clock::now();
+        
+        ceres::Solve(options, &problem, &summary);
+        
+        auto t2 = std::chrono::high_resolution_clock::now();
+        
+        buildTime += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        solveTime += std::chrono::duration<double, std::milli>(t2 - t1).count();
+    }
+    
+    cout << summary.FullReport() << endl;
+    cout << "parameters :";
+    for (auto parameter : parameters) {
+        cout << " " << parameter;
+    }
+    cout << endl;
+    cout << "build " << buildTime / repeatCount << "msec, solve " << solveTime / repeatCount << "msec (mean of " << repeatCount << ")" << endl;
+    
+    return 0;
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverImageAlignment.h"
+#include "CeresSolverThreadPool.h"
+
+#include "ofPixels.h"
+#include "ofPolyline.h"
+
+#include <ceres/cubic_interpolation.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Euclidean distance (in pixels) of every pixel to the nearest edge pixel, by
+	// the linear time lower envelope of parabolas (Felzenszwalb and Huttenlocher):
+	// one pass over the columns and one over the rows, each split over the thread pool.
+	// Read back through getDistance, which interpolates bicubically and works with Jets.
+	// This is the main per frame cost: about 70 ms for a 1080p edge image on one core,
+	// so camera frame rate needs several pool threads or a downscaled edge image.
+	// Tiling the column pass took this from about 77 ms (one channel) and 88 ms
+	// (three channels); the rest is the envelope itself rather than memory access.
+	class DistanceTransform {
+	public:
+		//----------
+		DistanceTransform() {}
+
+		DistanceTransform(const DistanceTransform &) = delete;
+		DistanceTransform & operator=(const DistanceTransform &) = delete;
+
+		//----------
+		// Edge pixels are those with the first channel above threshold (e.g. the
+		// output of a Canny filter). Distances are capped at maxDistance, so clutter
+		// far from the contour does not outweigh the rest of the fit.
+		template<typename PixelType>
+		void build(const ofPixels_<PixelType> & edges
+			, PixelType threshold = PixelType(0)
+			, float maxDistance = std::numeric_limits<float>::max()
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			const int width = (int) edges.getWidth();
+			const int height = (int) edges.getHeight();
+			const int channels = (int) edges.getNumChannels();
+			const auto data = edges.getData();
+
+			this->width = width;
+			this->height = height;
+			this->distances.resize((size_t) width * height);
+
+			// squared distance along each column. Columns go in tiles of ColumnTile,
+			// gathered and scattered row by row, so each row of the image is read and
+			// written as one short contiguous run rather than one pixel per row.
+			const int tiles = (width + ColumnTile - 1) / ColumnTile;
+			threadPool.parallelForChunked(tiles, [&](size_t begin, size_t end) {
+				Scratch scratch(height, ColumnTile);
+				for (int tile = (int) begin; tile < (int) end; tile++) {
+					const int left = tile * ColumnTile;
+					const int columns = std::min(ColumnTile, width - left);
+					for (int y = 0; y < height; y++) {
+						const auto pixels = data + ((size_t) y * width + left) * channels;
+						for (int i = 0; i < columns; i++) {
+							scratch.f[(size_t) i * height + y] = pixels[i * channels] > threshold ? 0.0 : infinity();
+						}
+					}
+					for (int i = 0; i < columns; i++) {
+						transform1D(scratch, (size_t) i * height, height);
+					}
+					for (int y = 0; y < height; y++) {
+						float * row = this->distances.data() + (size_t) y * width + left;
+						for (int i = 0; i < columns; i++) {
+							row[i] = (float) scratch.d[(size_t) i * height + y];
+						}
+					}
+				}
+			});
+
+			// then along each row, giving the squared Euclidean distance
+			const double maxDistance2 = (double) maxDistance * (double) maxDistance;
+			threadPool.parallelForChunked(height, [&](size_t begin, size_t end) {
+				Scratch scratch(width);
+				for (int y = (int) begin; y < (int) end; y++) {
+					float * row = this->distances.data() + (size_t) y * width;
+					for (int x = 0; x < width; x++) {
+						scratch.f[x] = row[x];
+					}
+					transform1D(scratch, 0, width);
+					for (int x = 0; x < width; x++) {
+						row[x] = (float) std::sqrt(std::min(scratch.d[x], maxDistance2));
+					}
+				}
+			});
+
+			this->grid.reset(new ceres::Grid2D<float>(this->distances.data(), 0, std::max(height, 1), 0, std::max(width, 1)));
+			this->interpolator.reset(new ceres::BiCubicInterpolator<ceres::Grid2D<float>>(*this->grid));
+		}
+
+		//----------
+		// Distance at a position in pixels, clamped to the image border
+		template<typename T>
+		T getDistance(const T & x, const T & y) const {
+			T distance;
+			this->interpolator->Evaluate(y, x, &distance);
+			return distance;
+		}
+
+		//----------
+		bool isAllocated() const {
+			return this->interpolator != nullptr;
+		}
+
+		//----------
+		int getWidth() const {
+			return this->width;
+		}
+
+		//----------
+		int getHeight() const {
+			return this->height;
+		}
+
+		//----------
+		// Row major, one float per pixel, e.g. for ofFloatPixels::setFromPixels
+		const std::vector<float> & getDistances() const {
+			return this->distances;
+		}
+
+	protected:
+		// columns per tile in the column pass
+		static const int ColumnTile = 16;
+
+		struct Scratch {
+			Scratch(int size, int lines = 1)
+				: f((size_t) size * lines)
+				, d((size_t) size * lines)
+				, v(size)
+				, z(size + 1) {}
+
+			std::vector<double> f; // input, lines of size one after another
+			std::vector<double> d; // output, as f
+			std::vector<int> v; // parabola vertices of the lower envelope
+			std::vector<double> z; // boundaries between them
+		};
+
+		//----------
+		// Large enough to lose to any real squared distance, small enough that
+		// differences between two of them stay finite
+		static double infinity() {
+			return 1e20;
+		}
+
+		//----------
+		// Where the parabolas rooted at q and p cross
+		static double intersect(const double * f, int q, int p) {
+			return ((f[q] + (double) q * q) - (f[p] + (double) p * p)) / (2.0 * (q - p));
+		}
+
+		//----------
+		// The line of size starting at start in scratch.f, into the same place in scratch.d
+		static void transform1D(Scratch & scratch, size_t start, int size) {
+			if (size == 0) {
+				return;
+			}
+			const double * f = scratch.f.data() + start;
+			double * d = scratch.d.data() + start;
+			auto & v = scratch.v;
+			auto & z = scratch.z;
+
+			int k = 0;
+			v[0] = 0;
+			z[0] = -std::numeric_limits<double>::infinity();
+			z[1] = std::numeric_limits<double>::infinity();
+			for (int q = 1; q < size; q++) {
+				// z[0] is -infinity, so this stops at the first parabola at the latest
+				double s = intersect(f, q, v[k]);
+				while (s <= z[k]) {
+					k--;
+					s = intersect(f, q, v[k]);
+				}
+				k++;
+				v[k] = q;
+				z[k] = s;
+				z[k + 1] = std::numeric_limits<double>::infinity();
+			}
+
+			k = 0;
+			for (int q = 0; q < size; q++) {
+				while (z[k + 1] < q) {
+					k++;
+				}
+				const double offset = q - v[k];
+				d[q] = offset * offset + f[v[k]];
+			}
+		}
+
+		int width = 0;
+		int height = 0;
+		std::vector<float> distances;
+		std::unique_ptr<ceres::Grid2D<float>> grid;
+		std::unique_ptr<ceres::BiCubicInterpolator<ceres::Grid2D<float>>> interpolator;
+	};
+
+	//----------
+	// Chamfer distance of a batch of contour samples, warped from contour
+	// coordinates into the image, so one residual block covers many samples.
+	template<typename Warp>
+	struct ChamferContourError {
+		ChamferContourError(const DistanceTransform & distanceTransform, const glm::vec2 * samples, size_t count)
+			: distanceTransform(distanceTransform)
+			, samples(samples)
+			, count(count) {}
+
+		template <typename T>
+		bool operator()(const T * const warpParameters
+			, T * residuals) const {
+			for (size_t i = 0; i < this->count; i++) {
+				T u, v;
+				Warp::apply(warpParameters, this->samples[i].x, this->samples[i].y, u, v);
+				residuals[i] = this->distanceTransform.getDistance(u, v);
+			}
+			return true;
+		}
+
+		const DistanceTransform & distanceTransform;
+		const glm::vec2 * samples;
+		size_t count;
+	};
+
+	//----------
+	// Fits an ofPolyline (e.g. a silhouette or the outline of a prop) to the edges
+	// of a camera image without correspondences, by minimizing the distance
+	// transform sampled along the contour. Warp is SimilarityWarp, AffineWarp or
+	// HomographyWarp. Parameters are kept between calls so video frames warm start
+	// from the previous fit.
+	template<typename Warp>
+	class ContourFitter {
+	public:
+		struct Settings {
+			// contour units between samples
+			float sampleSpacing = 2.0f;
+
+			// residuals per residual block
+			size_t samplesPerBlock = 256;
+
+			int maxIterations = 20;
+		};
+
+		//----------
+		ContourFitter() {
+			this->reset();
+		}
+
+		//----------
+		void setSettings(const Settings & settings) {
+			this->settings = settings;
+		}
+
+		//----------
+		// Back to the identity warp
+		void reset() {
+			for (int i = 0; i < Warp::NumParameters; i++) {
+				this->parameters[i] = (i == 0 || i == 4) ? 1.0 : 0.0;
+			}
+		}
+
+		//----------
+		void setContour(const ofPolyline & contour) {
+			const auto resampled = contour.getResampledBySpacing(this->settings.sampleSpacing);
+			this->samples.clear();
+			for (const auto & vertex : resampled.getVertices()) {
+				this->samples.emplace_back(vertex.x, vertex.y);
+			}
+		}
+
+		//----------
+		ceres::Solver::Summary fit(const DistanceTransform & distanceTransform) {
+			ceres::Solver::Summary summary;
+			if (this->samples.empty() || !distanceTransform.isAllocated()) {
+				return summary;
+			}
+
+			ceres::Problem problem;
+			const size_t samplesPerBlock = std::max<size_t>(this->settings.samplesPerBlock, 1);
+			for (size_t begin = 0; begin < this->samples.size(); begin += samplesPerBlock) {
+				const size_t count = std::min(samplesPerBlock, this->samples.size() - begin);
+				auto costFunction = new ceres::AutoDiffCostFunction<ChamferContourError<Warp>, ceres::DYNAMIC, Warp::NumParameters>(
+					new ChamferContourError<Warp>(distanceTransform, this->samples.data() + begin, count)
+					, (int) count);
+				problem.AddResidualBlock(costFunction, NULL, this->parameters);
+			}
+
+			ceres::Solver::Options options;
+			options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = this->settings.maxIterations;
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+			ceres::Solve(options, &problem, &summary);
+			return summary;
+		}
+
+		//----------
+		// Contour coordinates to image pixel coordinates
+		glm::mat3 getMatrix() const {
+			const auto matrix = Warp::toMatrix(this->parameters);
+			glm::mat3 result;
+			for (int column = 0; column < 3; column++) {
+				for (int row = 0; row < 3; row++) {
+					result[column][row] = matrix(row, column);
+				}
+			}
+			return result;
+		}
+
+		//----------
+		glm::vec2 transform(const glm::vec2 & point) const {
+			double u, v;
+			Warp::apply(this->parameters, point.x, point.y, u, v);
+			return glm::vec2(u, v);
+		}
+
+		//----------
+		const std::vector<glm::vec2> & getSamples() const {
+			return this->samples;
+		}
+
+		double parameters[Warp::NumParameters];
+
+	protected:
+		Settings settings;
+		std::vector<glm::vec2> samples;
+	};
+}
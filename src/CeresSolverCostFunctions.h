@@ -0,0 +1,84 @@
+#pragma once
+// RigidBodyTransformError reffered from
+// https://github.com/elliotwoods/ofxCeres/tree/master/Example-RigidBody
+#include "ofxCeresSolver.h"
+
+namespace ofxCeresSolver {
+	//----------
+	// Residual between a point and its correspondence after applying the
+	// 6 parameter transform (translation, euler rotation) to the point.
+	struct RigidBodyTransformError {
+		RigidBodyTransformError(const glm::tvec3<double> & untransformedPoint, const glm::tvec3<double> & transformedPoint)
+			: untransformedPoint(untransformedPoint)
+			, transformedPoint(transformedPoint) {}
+
+		template <typename T>
+		bool operator()(const T * const transformParameters
+			, T * residuals) const {
+
+			glm::tvec3<T> translation(transformParameters[0], transformParameters[1], transformParameters[2]);
+			glm::tvec3<T> rotationVector(transformParameters[3], transformParameters[4], transformParameters[5]);
+
+			// the bottom row is (0, 0, 0, 1), so w stays 1
+			auto transform = VectorMath::createAffineTransform(translation, rotationVector);
+			auto predictedTransformedPoint = transform.transformPoint(this->untransformedPoint);
+
+			for (int i = 0; i < 3; i++) {
+				residuals[i] = this->transformedPoint[i] - predictedTransformedPoint[i];
+			}
+
+			return true;
+		}
+
+		static ceres::CostFunction * Create(const glm::tvec3<double> & untransformedPoint, const glm::tvec3<double> & transformedPoint) {
+			return (new ceres::AutoDiffCostFunction<RigidBodyTransformError, 3, 6>(
+				new RigidBodyTransformError(untransformedPoint, transformedPoint)));
+		}
+
+		glm::tvec3<double> untransformedPoint;
+		glm::tvec3<double> transformedPoint;
+	};
+
+	//----------
+	// Distance of the transformed point from the tangent plane of its
+	// correspondence. Converges in fewer iterations than the point to point
+	// error on smooth surfaces since points are free to slide along the surface.
+	struct PointToPlaneTransformError {
+		PointToPlaneTransformError(const glm::tvec3<double> & untransformedPoint
+			, const glm::tvec3<double> & transformedPoint
+			, const glm::tvec3<double> & transformedNormal)
+			: untransformedPoint(untransformedPoint)
+			, transformedPoint(transformedPoint)
+			, transformedNormal(transformedNormal) {}
+
+		template <typename T>
+		bool operator()(const T * const transformParameters
+			, T * residuals) const {
+
+			glm::tvec3<T> translation(transformParameters[0], transformParameters[1], transformParameters[2]);
+			glm::tvec3<T> rotationVector(transformParameters[3], transformParameters[4], transformParameters[5]);
+
+			// the bottom row is (0, 0, 0, 1), so w stays 1
+			auto transform = VectorMath::createAffineTransform(translation, rotationVector);
+			auto predictedTransformedPoint = transform.transformPoint(this->untransformedPoint);
+
+			residuals[0] = T(0.0);
+			for (int i = 0; i < 3; i++) {
+				residuals[0] += (this->transformedPoint[i] - predictedTransformedPoint[i]) * this->transformedNormal[i];
+			}
+
+			return true;
+		}
+
+		static ceres::CostFunction * Create(const glm::tvec3<double> & untransformedPoint
+			, const glm::tvec3<double> & transformedPoint
+			, const glm::tvec3<double> & transformedNormal) {
+			return (new ceres::AutoDiffCostFunction<PointToPlaneTransformError, 1, 6>(
+				new PointToPlaneTransformError(untransformedPoint, transformedPoint, transformedNormal)));
+		}
+
+		glm::tvec3<double> untransformedPoint;
+		glm::tvec3<double> transformedPoint;
+		glm::tvec3<double> transformedNormal;
+	};
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverThreadPool.h"
+
+#include <Eigen/Dense>
+
+#include <mutex>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Covariance of a solved 6 parameter transform block (translation, euler rotation),
+	// e.g. as the measurement noise of a downstream Kalman filter.
+	// Like ceres::Covariance the result is inverse(JtJ) at the current parameters,
+	// optionally scaled by the residual variance when residuals are not already
+	// whitened by their measurement noise.
+	class PoseCovariance {
+	public:
+		//----------
+		// Problems with a single parameter block take a fast path which accumulates JtJ
+		// directly from the residual Jacobians over the thread pool. Anything else goes
+		// through ceres::Covariance with DENSE_SVD for small and SPARSE_QR for large problems.
+		bool estimate(ceres::Problem & problem
+			, double * poseParameters
+			, bool scaleByResidualVariance = false
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			this->valid = false;
+
+			Eigen::Matrix<double, 6, 6> covariance;
+			const bool singleBlock = problem.NumParameterBlocks() == 1
+				&& problem.HasParameterBlock(poseParameters)
+				&& problem.ParameterBlockSize(poseParameters) == 6
+				&& problem.GetParameterization(poseParameters) == NULL;
+
+			if (singleBlock) {
+				if (!estimateSingleBlock(problem, poseParameters, covariance, threadPool)) {
+					return false;
+				}
+			}
+			else {
+				ceres::Covariance::Options options;
+				options.algorithm_type = problem.NumParameters() <= DenseParameterLimit
+					? ceres::DENSE_SVD
+					: ceres::SPARSE_QR;
+
+				ceres::Covariance ceresCovariance(options);
+				std::vector<std::pair<const double *, const double *>> blocks;
+				blocks.push_back(std::make_pair(poseParameters, poseParameters));
+				if (!ceresCovariance.Compute(blocks, &problem)) {
+					return false;
+				}
+				// row major output
+				Eigen::Matrix<double, 6, 6, Eigen::RowMajor> block;
+				ceresCovariance.GetCovarianceBlock(poseParameters, poseParameters, block.data());
+				covariance = block;
+			}
+
+			if (scaleByResidualVariance) {
+				double cost = 0.0;
+				problem.Evaluate(ceres::Problem::EvaluateOptions(), &cost, NULL, NULL, NULL);
+				const int degreesOfFreedom = problem.NumResiduals() - problem.NumParameters();
+				if (degreesOfFreedom > 0) {
+					covariance *= 2.0 * cost / (double) degreesOfFreedom;
+				}
+			}
+
+			for (int column = 0; column < 6; column++) {
+				for (int row = 0; row < 6; row++) {
+					this->matrix[row * 6 + column] = covariance(row, column);
+				}
+			}
+			for (int column = 0; column < 3; column++) {
+				for (int row = 0; row < 3; row++) {
+					this->translation[column][row] = covariance(row, column);
+					this->rotation[column][row] = covariance(row + 3, column + 3);
+					this->translationRotation[column][row] = covariance(row, column + 3);
+				}
+			}
+
+			this->valid = true;
+			return true;
+		}
+
+		glm::mat3 translation;
+		glm::mat3 rotation; // euler angles, radians
+		glm::mat3 translationRotation; // cross covariance, rows are translation
+		double matrix[36]; // row major, parameter order
+		bool valid = false;
+
+		// DENSE_SVD is O(n^3) in all parameters of the problem
+		static const int DenseParameterLimit = 1000;
+
+	protected:
+		//----------
+		static bool estimateSingleBlock(ceres::Problem & problem
+			, double * poseParameters
+			, Eigen::Matrix<double, 6, 6> & covariance
+			, ThreadPool & threadPool) {
+			std::vector<ceres::ResidualBlockId> residualBlocks;
+			problem.GetResidualBlocks(&residualBlocks);
+
+			Eigen::Matrix<double, 6, 6> JtJ = Eigen::Matrix<double, 6, 6>::Zero();
+			std::mutex mutex;
+			bool succeeded = true;
+
+			threadPool.parallelForChunked(residualBlocks.size(), [&](size_t begin, size_t end) {
+				Eigen::Matrix<double, 6, 6> localJtJ = Eigen::Matrix<double, 6, 6>::Zero();
+				std::vector<double> residuals;
+				std::vector<double> jacobian;
+				const double * parameterBlocks[] = { poseParameters };
+
+				for (size_t i = begin; i < end; i++) {
+					const auto costFunction = problem.GetCostFunctionForResidualBlock(residualBlocks[i]);
+					const auto lossFunction = problem.GetLossFunctionForResidualBlock(residualBlocks[i]);
+					const int residualCount = costFunction->num_residuals();
+					residuals.resize(residualCount);
+					jacobian.resize(residualCount * 6);
+					double * jacobians[] = { jacobian.data() };
+
+					if (!costFunction->Evaluate(parameterBlocks, residuals.data(), jacobians)) {
+						std::lock_guard<std::mutex> lock(mutex);
+						succeeded = false;
+						return;
+					}
+
+					Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 6, Eigen::RowMajor>> J(jacobian.data(), residualCount, 6);
+					double weight = 1.0;
+					if (lossFunction) {
+						// first order robust weighting, as ceres applies in Covariance
+						double squaredNorm = 0.0;
+						for (auto residual : residuals) {
+							squaredNorm += residual * residual;
+						}
+						double rho[3];
+						lossFunction->Evaluate(squaredNorm, rho);
+						weight = rho[1];
+					}
+					localJtJ.selfadjointView<Eigen::Upper>().rankUpdate(J.transpose(), weight);
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				JtJ += localJtJ;
+			});
+
+			if (!succeeded) {
+				return false;
+			}
+
+			// pseudo inverse with the same rank test as ceres DENSE_SVD
+			Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 6, 6>> solver(JtJ.selfadjointView<Eigen::Upper>());
+			const auto & eigenvalues = solver.eigenvalues();
+			if (eigenvalues(5) <= 0.0 || eigenvalues(0) / eigenvalues(5) < MinReciprocalConditionNumber) {
+				return false;
+			}
+			covariance = solver.eigenvectors() * eigenvalues.cwiseInverse().asDiagonal() * solver.eigenvectors().transpose();
+			return true;
+		}
+
+		static constexpr double MinReciprocalConditionNumber = 1e-14;
+	};
+}
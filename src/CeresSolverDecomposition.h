@@ -0,0 +1,275 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverThreadPool.h"
+
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Splits a problem into the connected components of its parameter / residual
+	// graph (e.g. projector clusters which share no parameter blocks) and solves
+	// each component as its own problem over the thread pool. Residual blocks only
+	// connect through variable parameter blocks, so constant blocks (e.g. fixed
+	// calibration) may be shared by several components. Every sub problem points
+	// at the original cost functions, loss functions, parameterizations and
+	// parameter memory, so the solution lands in place and nothing is copied back.
+	//
+	// Components are solved concurrently, so cost and loss functions shared
+	// between components must be safe to evaluate from several threads, as they
+	// are when ceres runs with num_threads > 1.
+	//
+	// BOUNDS ARE NOT CARRIED OVER: ceres 1.14 can not read parameter bounds back
+	// from a problem, so a bounded problem solved without Settings::setBounds is
+	// solved unbounded. setBounds must set the same bounds on every sub problem.
+	//
+	// Residual blocks whose parameter blocks are all constant can not change the
+	// solution, so they belong to no component and are not solved. Their cost is
+	// not part of Result::initialCost and finalCost.
+	//
+	// Solver options which see the whole problem are not split: with an
+	// evaluation_callback or any iteration callbacks the problem is solved as a
+	// whole, so callbacks run once per iteration on one thread as they expect.
+	// linear_solver_ordering and inner_iteration_ordering are given to each sub
+	// problem restricted to its own parameter blocks, keeping their groups.
+	class ProblemDecomposition {
+	public:
+		struct Component {
+			std::vector<double *> parameterBlocks; // including constant ones
+			std::vector<ceres::ResidualBlockId> residualBlocks;
+		};
+
+		struct Settings {
+			ceres::Solver::Options solverOptions;
+
+			// Required for bounded problems, see above. Called for every parameter
+			// block of every sub problem.
+			std::function<void(ceres::Problem & subProblem, double * parameterBlock)> setBounds;
+		};
+
+		struct Result {
+			std::vector<Component> components;
+			std::vector<ceres::Solver::Summary> summaries; // per component
+			double initialCost = 0.0;
+			double finalCost = 0.0;
+
+			//----------
+			bool isSolutionUsable() const {
+				for (const auto & summary : this->summaries) {
+					if (!summary.IsSolutionUsable()) {
+						return false;
+					}
+				}
+				return !this->summaries.empty();
+			}
+
+			//----------
+			std::string getReport() const {
+				std::stringstream stream;
+				stream << this->components.size() << " components, cost " << this->initialCost << " -> " << this->finalCost << std::endl;
+				if (this->summaries.size() != this->components.size()) {
+					// solved as a whole
+					for (const auto & summary : this->summaries) {
+						stream << summary.BriefReport() << std::endl;
+					}
+					return stream.str();
+				}
+				for (size_t i = 0; i < this->summaries.size(); i++) {
+					stream << i << " : " << this->components[i].parameterBlocks.size() << " parameter blocks, "
+						<< this->components[i].residualBlocks.size() << " residual blocks : "
+						<< this->summaries[i].BriefReport() << std::endl;
+				}
+				return stream.str();
+			}
+		};
+
+		//----------
+		// Components in the order of their first residual block. Parameter blocks
+		// without residual blocks, and residual blocks on constant parameter blocks
+		// only, belong to no component.
+		static std::vector<Component> findComponents(const ceres::Problem & problem) {
+			std::vector<double *> parameterBlocks;
+			problem.GetParameterBlocks(&parameterBlocks);
+			std::unordered_map<const double *, size_t> parameterIndices;
+			parameterIndices.reserve(parameterBlocks.size());
+			for (size_t i = 0; i < parameterBlocks.size(); i++) {
+				parameterIndices[parameterBlocks[i]] = i;
+			}
+
+			// union find over the variable parameter blocks
+			std::vector<size_t> parents(parameterBlocks.size());
+			std::iota(parents.begin(), parents.end(), 0);
+			auto find = [&parents](size_t index) {
+				while (parents[index] != index) {
+					parents[index] = parents[parents[index]];
+					index = parents[index];
+				}
+				return index;
+			};
+
+			std::vector<ceres::ResidualBlockId> residualBlocks;
+			problem.GetResidualBlocks(&residualBlocks);
+			std::vector<std::vector<double *>> residualParameterBlocks(residualBlocks.size());
+			for (size_t i = 0; i < residualBlocks.size(); i++) {
+				auto & blocks = residualParameterBlocks[i];
+				problem.GetParameterBlocksForResidualBlock(residualBlocks[i], &blocks);
+				size_t root = parents.size();
+				for (auto block : blocks) {
+					if (problem.IsParameterBlockConstant(block)) {
+						continue;
+					}
+					const size_t blockRoot = find(parameterIndices[block]);
+					if (root == parents.size()) {
+						root = blockRoot;
+					}
+					else if (blockRoot != root) {
+						parents[blockRoot] = root;
+					}
+				}
+			}
+
+			std::vector<Component> components;
+			std::unordered_map<size_t, size_t> componentIndices;
+			std::vector<std::unordered_set<const double *>> componentParameterBlocks;
+			for (size_t i = 0; i < residualBlocks.size(); i++) {
+				const auto & blocks = residualParameterBlocks[i];
+				size_t key = parents.size();
+				for (auto block : blocks) {
+					if (!problem.IsParameterBlockConstant(block)) {
+						key = find(parameterIndices[block]);
+						break;
+					}
+				}
+				if (key == parents.size()) {
+					// constant parameter blocks only, nothing to solve
+					continue;
+				}
+
+				auto findComponent = componentIndices.find(key);
+				size_t componentIndex;
+				if (findComponent == componentIndices.end()) {
+					componentIndex = components.size();
+					componentIndices[key] = componentIndex;
+					components.emplace_back();
+					componentParameterBlocks.emplace_back();
+				}
+				else {
+					componentIndex = findComponent->second;
+				}
+
+				auto & component = components[componentIndex];
+				component.residualBlocks.push_back(residualBlocks[i]);
+				for (auto block : blocks) {
+					if (componentParameterBlocks[componentIndex].insert(block).second) {
+						component.parameterBlocks.push_back(block);
+					}
+				}
+			}
+
+			return components;
+		}
+
+		//----------
+		// A single component (or callbacks, which see the whole problem) is solved directly.
+		static Result solve(ceres::Problem & problem
+			, const Settings & settings
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			Result result;
+			result.components = findComponents(problem);
+			if (result.components.size() <= 1
+				|| settings.solverOptions.evaluation_callback
+				|| !settings.solverOptions.callbacks.empty()) {
+				result.summaries.resize(1);
+				ceres::Solve(settings.solverOptions, &problem, &result.summaries[0]);
+				result.initialCost = result.summaries[0].initial_cost;
+				result.finalCost = result.summaries[0].final_cost;
+				return result;
+			}
+
+			result.summaries.resize(result.components.size());
+			threadPool.parallelFor(result.components.size(), [&](size_t i) {
+				auto subProblem = createSubProblem(problem, result.components[i], settings);
+				ceres::Solve(getSubProblemOptions(settings.solverOptions, result.components[i])
+					, subProblem.get()
+					, &result.summaries[i]);
+			});
+
+			for (const auto & summary : result.summaries) {
+				result.initialCost += summary.initial_cost;
+				result.finalCost += summary.final_cost;
+			}
+			return result;
+		}
+
+		//----------
+		// The sub problem does not own anything it points at
+		static std::unique_ptr<ceres::Problem> createSubProblem(ceres::Problem & problem
+			, const Component & component
+			, const Settings & settings) {
+			ceres::Problem::Options options;
+			options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+			options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+			options.local_parameterization_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+			// the blocks were already checked when added to the full problem
+			options.disable_all_safety_checks = true;
+			std::unique_ptr<ceres::Problem> subProblem(new ceres::Problem(options));
+
+			for (auto block : component.parameterBlocks) {
+				subProblem->AddParameterBlock(block
+					, problem.ParameterBlockSize(block)
+					, const_cast<ceres::LocalParameterization *>(problem.GetParameterization(block)));
+				if (problem.IsParameterBlockConstant(block)) {
+					subProblem->SetParameterBlockConstant(block);
+				}
+				if (settings.setBounds) {
+					settings.setBounds(*subProblem, block);
+				}
+			}
+
+			std::vector<double *> blocks;
+			for (auto residualBlock : component.residualBlocks) {
+				problem.GetParameterBlocksForResidualBlock(residualBlock, &blocks);
+				subProblem->AddResidualBlock(const_cast<ceres::CostFunction *>(problem.GetCostFunctionForResidualBlock(residualBlock))
+					, const_cast<ceres::LossFunction *>(problem.GetLossFunctionForResidualBlock(residualBlock))
+					, blocks);
+			}
+
+			return subProblem;
+		}
+
+		//----------
+		// The solver options with the orderings restricted to the component
+		static ceres::Solver::Options getSubProblemOptions(const ceres::Solver::Options & options
+			, const Component & component) {
+			auto subProblemOptions = options;
+			subProblemOptions.linear_solver_ordering = restrictOrdering(options.linear_solver_ordering, component);
+			subProblemOptions.inner_iteration_ordering = restrictOrdering(options.inner_iteration_ordering, component);
+			return subProblemOptions;
+		}
+
+	protected:
+		//----------
+		// A new ordering (so sub problems solved concurrently share nothing) with
+		// the component's parameter blocks in their original groups
+		static std::shared_ptr<ceres::ParameterBlockOrdering> restrictOrdering(const std::shared_ptr<ceres::ParameterBlockOrdering> & ordering
+			, const Component & component) {
+			if (!ordering) {
+				return ordering;
+			}
+			std::shared_ptr<ceres::ParameterBlockOrdering> restricted(new ceres::ParameterBlockOrdering());
+			for (auto block : component.parameterBlocks) {
+				if (ordering->IsMember(block)) {
+					restricted->AddElementToGroup(block, ordering->GroupId(block));
+				}
+			}
+			return restricted;
+		}
+	};
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverThreadPool.h"
+
+#include <Eigen/Dense>
+
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Transfer error of one point pair under a homography with h22 fixed to 1.
+	// Parameters are the first 8 entries of the row major 3x3 matrix.
+	// The Jacobian is analytic, which avoids 8-wide Jets for every point.
+	class HomographyError : public ceres::SizedCostFunction<2, 8> {
+	public:
+		HomographyError(const glm::tvec2<double> & sourcePoint, const glm::tvec2<double> & targetPoint)
+			: sourcePoint(sourcePoint)
+			, targetPoint(targetPoint) {}
+
+		bool Evaluate(double const * const * parameters
+			, double * residuals
+			, double ** jacobians) const override {
+			const double * h = parameters[0];
+			const double x = this->sourcePoint.x;
+			const double y = this->sourcePoint.y;
+
+			const double w = h[6] * x + h[7] * y + 1.0;
+			if (w == 0.0) {
+				return false;
+			}
+			const double inverseW = 1.0 / w;
+			const double projectedX = (h[0] * x + h[1] * y + h[2]) * inverseW;
+			const double projectedY = (h[3] * x + h[4] * y + h[5]) * inverseW;
+
+			residuals[0] = projectedX - this->targetPoint.x;
+			residuals[1] = projectedY - this->targetPoint.y;
+
+			if (jacobians && jacobians[0]) {
+				const double xw = x * inverseW;
+				const double yw = y * inverseW;
+				double * row0 = jacobians[0];
+				double * row1 = jacobians[0] + 8;
+
+				row0[0] = xw;
+				row0[1] = yw;
+				row0[2] = inverseW;
+				row0[3] = 0.0;
+				row0[4] = 0.0;
+				row0[5] = 0.0;
+				row0[6] = -projectedX * xw;
+				row0[7] = -projectedX * yw;
+
+				row1[0] = 0.0;
+				row1[1] = 0.0;
+				row1[2] = 0.0;
+				row1[3] = xw;
+				row1[4] = yw;
+				row1[5] = inverseW;
+				row1[6] = -projectedY * xw;
+				row1[7] = -projectedY * yw;
+			}
+
+			return true;
+		}
+
+		static ceres::CostFunction * Create(const glm::tvec2<double> & sourcePoint, const glm::tvec2<double> & targetPoint) {
+			return new HomographyError(sourcePoint, targetPoint);
+		}
+
+	protected:
+		glm::tvec2<double> sourcePoint;
+		glm::tvec2<double> targetPoint;
+	};
+
+	//----------
+	// Planar homography from point pairs: normalized DLT for the initial
+	// estimate, then a least squares refinement of the transfer error.
+	class Homography {
+	public:
+		struct Settings {
+			Settings()
+				: refine(true)
+				, warmStart(false)
+				, maxIterations(10) {}
+
+			bool refine;
+
+			// use the current parameters (e.g. last frame) instead of the DLT as the starting point
+			bool warmStart;
+
+			int maxIterations;
+		};
+
+		struct PointPairs {
+			std::vector<glm::vec2> source;
+			std::vector<glm::vec2> target;
+		};
+
+		//----------
+		Homography() {
+			this->reset();
+		}
+
+		//----------
+		void reset() {
+			for (int i = 0; i < 8; i++) {
+				this->parameters[i] = (i == 0 || i == 4) ? 1.0 : 0.0;
+			}
+			this->valid = false;
+		}
+
+		//----------
+		// Needs at least 4 pairs
+		bool estimate(const std::vector<glm::vec2> & source
+			, const std::vector<glm::vec2> & target
+			, const Settings & settings = Settings()) {
+			if (source.size() < 4 || source.size() != target.size()) {
+				return false;
+			}
+
+			if (!(settings.warmStart && this->valid)) {
+				if (!estimateDLT(source, target, this->parameters)) {
+					return false;
+				}
+				this->valid = true;
+			}
+
+			if (settings.refine) {
+				ceres::Problem problem;
+				for (size_t i = 0; i < source.size(); i++) {
+					problem.AddResidualBlock(HomographyError::Create(source[i], target[i])
+						, NULL
+						, this->parameters);
+				}
+
+				ceres::Solver::Options options;
+				options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+				options.max_num_iterations = settings.maxIterations;
+				options.minimizer_progress_to_stdout = false;
+				options.logging_type = ceres::SILENT;
+				ceres::Solve(options, &problem, &this->summary);
+			}
+
+			return true;
+		}
+
+		//----------
+		// Each surface is solved as a task on the thread pool.
+		// results keeps its existing entries, so settings.warmStart carries over from the previous frame.
+		static void estimate(const std::vector<PointPairs> & surfaces
+			, std::vector<Homography> & results
+			, const Settings & settings = Settings()
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			results.resize(surfaces.size());
+			threadPool.parallelFor(surfaces.size(), [&](size_t i) {
+				results[i].estimate(surfaces[i].source, surfaces[i].target, settings);
+			});
+		}
+
+		//----------
+		// Direct linear transform on points normalized to zero mean and mean distance sqrt(2).
+		static bool estimateDLT(const std::vector<glm::vec2> & source
+			, const std::vector<glm::vec2> & target
+			, double * parameters) {
+			const size_t count = source.size();
+			if (count < 4 || count != target.size()) {
+				return false;
+			}
+
+			Eigen::Matrix3d sourceNormalization = getNormalization(source);
+			Eigen::Matrix3d targetNormalization = getNormalization(target);
+
+			// accumulate AtA directly rather than forming the 2N x 9 A
+			Eigen::Matrix<double, 9, 9> AtA = Eigen::Matrix<double, 9, 9>::Zero();
+			for (size_t i = 0; i < count; i++) {
+				const Eigen::Vector3d s = sourceNormalization * Eigen::Vector3d(source[i].x, source[i].y, 1.0);
+				const Eigen::Vector3d t = targetNormalization * Eigen::Vector3d(target[i].x, target[i].y, 1.0);
+
+				Eigen::Matrix<double, 9, 1> row0, row1;
+				row0 << s.x(), s.y(), 1.0, 0.0, 0.0, 0.0, -t.x() * s.x(), -t.x() * s.y(), -t.x();
+				row1 << 0.0, 0.0, 0.0, s.x(), s.y(), 1.0, -t.y() * s.x(), -t.y() * s.y(), -t.y();
+				AtA.selfadjointView<Eigen::Upper>().rankUpdate(row0);
+				AtA.selfadjointView<Eigen::Upper>().rankUpdate(row1);
+			}
+
+			// eigenvalues come out in increasing order
+			Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9>> solver(AtA.selfadjointView<Eigen::Upper>());
+			const Eigen::Matrix<double, 9, 1> h = solver.eigenvectors().col(0);
+
+			Eigen::Matrix3d normalizedH;
+			normalizedH << h(0), h(1), h(2)
+				, h(3), h(4), h(5)
+				, h(6), h(7), h(8);
+
+			const Eigen::Matrix3d H = targetNormalization.inverse() * normalizedH * sourceNormalization;
+			if (std::abs(H(2, 2)) < std::numeric_limits<double>::epsilon()) {
+				return false;
+			}
+
+			for (int i = 0; i < 8; i++) {
+				parameters[i] = H(i / 3, i % 3) / H(2, 2);
+			}
+			return true;
+		}
+
+		//----------
+		bool isValid() const {
+			return this->valid;
+		}
+
+		//----------
+		const ceres::Solver::Summary & getSummary() const {
+			return this->summary;
+		}
+
+		//----------
+		glm::vec2 transform(const glm::vec2 & point) const {
+			const auto & h = this->parameters;
+			const double w = h[6] * point.x + h[7] * point.y + 1.0;
+			return glm::vec2((h[0] * point.x + h[1] * point.y + h[2]) / w
+				, (h[3] * point.x + h[4] * point.y + h[5]) / w);
+		}
+
+		//----------
+		// glm is column major, so the row major parameters are transposed here
+		glm::mat3 getMatrix() const {
+			const auto & h = this->parameters;
+			return glm::mat3(h[0], h[3], h[6]
+				, h[1], h[4], h[7]
+				, h[2], h[5], 1.0);
+		}
+
+		//----------
+		// Homography acting on the z = 0 plane, for ofMultMatrix / ofMatrix4x4
+		glm::mat4 getTransform() const {
+			const auto & h = this->parameters;
+			return glm::mat4(h[0], h[3], 0.0, h[6]
+				, h[1], h[4], 0.0, h[7]
+				, 0.0, 0.0, 1.0, 0.0
+				, h[2], h[5], 0.0, 1.0);
+		}
+
+		//----------
+		// Pose of the plane z = 0 in camera space given the camera matrix,
+		// when the source points are plane coordinates and the target points are image pixels.
+		glm::mat4 getPlanarPose(const glm::mat3 & cameraMatrix) const {
+			Eigen::Matrix3d K;
+			for (int row = 0; row < 3; row++) {
+				for (int column = 0; column < 3; column++) {
+					K(row, column) = cameraMatrix[column][row];
+				}
+			}
+
+			Eigen::Matrix3d H;
+			const auto & h = this->parameters;
+			H << h[0], h[1], h[2]
+				, h[3], h[4], h[5]
+				, h[6], h[7], 1.0;
+
+			Eigen::Matrix3d M = K.inverse() * H;
+			double scale = 1.0 / M.col(0).norm();
+			if (M(2, 2) < 0.0) {
+				// plane in front of the camera
+				scale = -scale;
+			}
+			M *= scale;
+
+			Eigen::Matrix3d rotation;
+			rotation.col(0) = M.col(0);
+			rotation.col(1) = M.col(1);
+			rotation.col(2) = M.col(0).cross(M.col(1));
+
+			// nearest rotation matrix
+			Eigen::JacobiSVD<Eigen::Matrix3d> svd(rotation, Eigen::ComputeFullU | Eigen::ComputeFullV);
+			rotation = svd.matrixU() * svd.matrixV().transpose();
+
+			glm::mat4 pose(1.0f);
+			for (int column = 0; column < 3; column++) {
+				for (int row = 0; row < 3; row++) {
+					pose[column][row] = rotation(row, column);
+				}
+				pose[3][column] = M(column, 2);
+			}
+			return pose;
+		}
+
+		double parameters[8];
+
+	protected:
+		//----------
+		static Eigen::Matrix3d getNormalization(const std::vector<glm::vec2> & points) {
+			Eigen::Vector2d mean = Eigen::Vector2d::Zero();
+			for (const auto & point : points) {
+				mean += Eigen::Vector2d(point.x, point.y);
+			}
+			mean /= (double) points.size();
+
+			double meanDistance = 0.0;
+			for (const auto & point : points) {
+				meanDistance += (Eigen::Vector2d(point.x, point.y) - mean).norm();
+			}
+			meanDistance /= (double) points.size();
+
+			const double scale = meanDistance > 0.0 ? sqrt(2.0) / meanDistance : 1.0;
+			Eigen::Matrix3d normalization;
+			normalization << scale, 0.0, -scale * mean.x()
+				, 0.0, scale, -scale * mean.y()
+				, 0.0, 0.0, 1.0;
+			return normalization;
+		}
+
+		ceres::Solver::Summary summary;
+		bool valid = false;
+	};
+}
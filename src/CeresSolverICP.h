@@ -0,0 +1,287 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverCostFunctions.h"
+#include "CeresSolverKdTree.h"
+#include "CeresSolverThreadPool.h"
+#include "CeresSolverTransformCache.h"
+
+#include <Eigen/Eigenvalues>
+
+#include <memory>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Iterative closest point registration of a source cloud onto a reference cloud.
+	// Correspondences come from a KdTree over the reference, and each iteration
+	// refines the 6 parameter transform with RigidBodyTransformError or
+	// PointToPlaneTransformError. The transform is kept between calls to solve()
+	// so consecutive frames warm start from the previous result.
+	class ICP {
+	public:
+		struct Settings {
+			int maxIterations = 30;
+
+			// correspondences further apart than this are rejected. 0 = no limit
+			float maxCorrespondenceDistance = 0.0f;
+
+			// source points are subsampled with a uniform stride down to this count. 0 = use all
+			size_t maxSourcePoints = 0;
+
+			bool pointToPlane = false;
+
+			// neighbours used when normals have to be estimated for pointToPlane
+			int normalNeighbours = 8;
+
+			// Huber loss scale against outliers. 0 = plain least squares
+			double lossScale = 0.0;
+
+			// stop when an iteration moves the parameters less than this
+			double parameterTolerance = 1e-6;
+
+			size_t leafSize = 16;
+
+			ceres::Solver::Options solverOptions = defaultSolverOptions();
+		};
+
+		struct Result {
+			bool converged = false;
+			int iterations = 0;
+			size_t correspondences = 0;
+			double rmsError = 0.0;
+		};
+
+		//----------
+		static ceres::Solver::Options defaultSolverOptions() {
+			ceres::Solver::Options options;
+			// one 6 parameter block, so the normal equations are only 6x6
+			options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = 5;
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+			return options;
+		}
+
+		//----------
+		ICP(ThreadPool & threadPool = ThreadPool::getShared())
+			: threadPool(threadPool) {
+			this->reset();
+		}
+
+		//----------
+		void setSettings(const Settings & settings) {
+			this->settings = settings;
+		}
+
+		//----------
+		const Settings & getSettings() const {
+			return this->settings;
+		}
+
+		//----------
+		// Normals are only used when settings.pointToPlane is set. If they are
+		// not given, they are estimated from the reference neighbourhoods on demand.
+		void setReference(const std::vector<glm::vec3> & points, const std::vector<glm::vec3> & normals = std::vector<glm::vec3>()) {
+			this->referencePoints = points;
+			this->referenceNormals = normals;
+			this->referenceTree.build(this->referencePoints, this->settings.leafSize);
+		}
+
+		//----------
+		const KdTree & getReferenceTree() const {
+			return this->referenceTree;
+		}
+
+		//----------
+		// Forget the previous result and start the next solve from identity
+		void reset() {
+			for (auto & parameter : this->parameters) {
+				parameter = 0.0;
+			}
+		}
+
+		//----------
+		// translation xyz followed by euler rotation xyz, as in RigidBodyTransformError
+		void setTransformParameters(const double * parameters) {
+			std::copy(parameters, parameters + 6, this->parameters);
+		}
+
+		//----------
+		const double * getTransformParameters() const {
+			return this->parameters;
+		}
+
+		//----------
+		// Maps source points onto the reference.
+		glm::mat4 getTransform() const {
+			return glm::mat4(getTransform(this->parameters));
+		}
+
+		//----------
+		Result solve(const std::vector<glm::vec3> & sourcePoints) {
+			Result result;
+			if (sourcePoints.empty() || this->referenceTree.empty()) {
+				return result;
+			}
+
+			if (this->settings.pointToPlane && this->referenceNormals.size() != this->referencePoints.size()) {
+				estimateNormals(this->referencePoints, this->referenceTree, this->settings.normalNeighbours, this->referenceNormals, this->threadPool);
+			}
+
+			// subsample
+			std::vector<glm::vec3> & source = this->sampledSource;
+			source.clear();
+			{
+				const size_t stride = this->settings.maxSourcePoints > 0
+					? std::max((size_t) 1, sourcePoints.size() / this->settings.maxSourcePoints)
+					: 1;
+				source.reserve(sourcePoints.size() / stride + 1);
+				for (size_t i = 0; i < sourcePoints.size(); i += stride) {
+					source.push_back(sourcePoints[i]);
+				}
+			}
+
+			const float maxDistance2 = this->settings.maxCorrespondenceDistance > 0.0f
+				? this->settings.maxCorrespondenceDistance * this->settings.maxCorrespondenceDistance
+				: std::numeric_limits<float>::max();
+
+			std::vector<glm::vec3> & transformed = this->transformedSource;
+			transformed.resize(source.size());
+			std::vector<KdTree::Result> & matches = this->matches;
+
+			// all residual blocks share the one transform
+			SharedTransformCache transformCache;
+			const auto & cachedTransform = transformCache.add(this->parameters);
+			auto solverOptions = this->settings.solverOptions;
+			transformCache.attach(solverOptions);
+
+			for (result.iterations = 0; result.iterations < this->settings.maxIterations; ) {
+				result.iterations++;
+
+				// find correspondences under the current estimate
+				const auto transform = this->getTransform();
+				this->threadPool.parallelFor(source.size(), [&](size_t i) {
+					transformed[i] = glm::vec3(transform * glm::vec4(source[i], 1.0f));
+				});
+				this->referenceTree.findNearest(transformed, matches, maxDistance2, this->threadPool);
+
+				// refine
+				double previousParameters[6];
+				std::copy(this->parameters, this->parameters + 6, previousParameters);
+
+				std::unique_ptr<ceres::LossFunction> lossFunction;
+				if (this->settings.lossScale > 0.0) {
+					lossFunction.reset(new ceres::HuberLoss(this->settings.lossScale));
+				}
+
+				ceres::Problem::Options problemOptions;
+				problemOptions.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+				ceres::Problem problem(problemOptions);
+
+				result.correspondences = 0;
+				for (size_t i = 0; i < source.size(); i++) {
+					const auto & match = matches[i];
+					if (match.index == KdTree::NotFound) {
+						continue;
+					}
+
+					ceres::CostFunction * costFunction;
+					if (this->settings.pointToPlane) {
+						costFunction = CachedPointToPlaneTransformError::Create(cachedTransform
+							, source[i]
+							, this->referencePoints[match.index]
+							, this->referenceNormals[match.index]);
+					}
+					else {
+						costFunction = CachedRigidBodyTransformError::Create(cachedTransform
+							, source[i]
+							, this->referencePoints[match.index]);
+					}
+					problem.AddResidualBlock(costFunction
+						, lossFunction.get()
+						, this->parameters);
+					result.correspondences++;
+				}
+
+				if (result.correspondences < 3) {
+					break;
+				}
+
+				ceres::Solver::Summary summary;
+				ceres::Solve(solverOptions, &problem, &summary);
+				result.rmsError = sqrt(2.0 * summary.final_cost / (double) result.correspondences);
+
+				double change = 0.0;
+				for (int i = 0; i < 6; i++) {
+					change = std::max(change, std::abs(this->parameters[i] - previousParameters[i]));
+				}
+				if (change < this->settings.parameterTolerance) {
+					result.converged = true;
+					break;
+				}
+			}
+
+			return result;
+		}
+
+		//----------
+		// Surface normals from the smallest principal axis of each point's neighbourhood.
+		// The sign of each normal is arbitrary, which does not matter to the point to plane error.
+		static void estimateNormals(const std::vector<glm::vec3> & points
+			, const KdTree & tree
+			, int neighbourCount
+			, std::vector<glm::vec3> & normals
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			normals.resize(points.size());
+
+			threadPool.parallelForChunked(points.size(), [&](size_t begin, size_t end) {
+				std::vector<KdTree::Result> neighbours;
+				for (size_t i = begin; i < end; i++) {
+					tree.findKNearest(points[i], std::max(3, neighbourCount), neighbours);
+
+					Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+					for (const auto & neighbour : neighbours) {
+						const auto & point = points[neighbour.index];
+						mean += Eigen::Vector3d(point.x, point.y, point.z);
+					}
+					mean /= (double) neighbours.size();
+
+					Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+					for (const auto & neighbour : neighbours) {
+						const auto & point = points[neighbour.index];
+						const Eigen::Vector3d delta = Eigen::Vector3d(point.x, point.y, point.z) - mean;
+						covariance += delta * delta.transpose();
+					}
+
+					// eigenvalues come out in increasing order
+					Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+					const Eigen::Vector3d normal = solver.eigenvectors().col(0);
+					normals[i] = glm::vec3(normal.x(), normal.y(), normal.z());
+				}
+			});
+		}
+
+		//----------
+		static glm::tmat4x4<double> getTransform(const double * parameters) {
+			glm::tvec3<double> translation(parameters[0], parameters[1], parameters[2]);
+			glm::tvec3<double> rotationVector(parameters[3], parameters[4], parameters[5]);
+			return VectorMath::createTransform(translation, rotationVector);
+		}
+
+	protected:
+		Settings settings;
+		ThreadPool & threadPool;
+
+		std::vector<glm::vec3> referencePoints;
+		std::vector<glm::vec3> referenceNormals;
+		KdTree referenceTree;
+
+		double parameters[6];
+
+		// reused between frames to avoid reallocating
+		std::vector<glm::vec3> sampledSource;
+		std::vector<glm::vec3> transformedSource;
+		std::vector<KdTree::Result> matches;
+	};
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverPreallocatedAutoDiff.h"
+#include "CeresSolverThreadPool.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Position of one joint of a chain given the euler angles of all its ancestors.
+	// Each ancestor contributes translate(offset) * rotate(angles), the same
+	// composition as VectorMath::createTransform, so the chain matches an ofNode
+	// hierarchy where each node's position is its offset from its parent.
+	struct IKChainError {
+		IKChainError(const glm::tmat4x4<double> & rootTransform
+			, const std::vector<glm::tvec3<double>> & chainOffsets
+			, const glm::tvec3<double> & effectorOffset
+			, const glm::tvec3<double> & target
+			, double weight)
+			: rootTransform(rootTransform)
+			, chainOffsets(chainOffsets)
+			, effectorOffset(effectorOffset)
+			, target(target)
+			, weight(weight) {}
+
+		template <typename T>
+		bool operator()(T const * const * jointAngles
+			, T * residuals) const {
+			VectorMath::Affine<T> transform(this->rootTransform);
+
+			for (size_t i = 0; i < this->chainOffsets.size(); i++) {
+				const auto & offset = this->chainOffsets[i];
+				glm::tvec3<T> translation(T(offset.x), T(offset.y), T(offset.z));
+				glm::tvec3<T> rotationVector(jointAngles[i][0], jointAngles[i][1], jointAngles[i][2]);
+				transform = transform * VectorMath::createAffineTransform(translation, rotationVector);
+			}
+
+			auto effector = transform.transformPoint(this->effectorOffset);
+			for (int i = 0; i < 3; i++) {
+				residuals[i] = (effector[i] - this->target[i]) * this->weight;
+			}
+
+			return true;
+		}
+
+		glm::tmat4x4<double> rootTransform;
+		std::vector<glm::tvec3<double>> chainOffsets;
+		glm::tvec3<double> effectorOffset;
+		glm::tvec3<double> target;
+		double weight;
+	};
+
+	//----------
+	// A joint hierarchy with euler angle joints solved towards end effector targets.
+	// Angles are kept between solves, so each frame starts from the previous pose.
+	// Joint limits go to the problem as parameter bounds. An axis whose lower and
+	// upper limit are equal is locked with a SubsetParameterization instead,
+	// which is how hinge (1 axis) and universal (2 axis) joints are expressed.
+	class IKSkeleton {
+	public:
+		typedef int JointID;
+
+		struct Settings {
+			int maxIterations = 20;
+			double functionTolerance = 1e-8;
+		};
+
+		//----------
+		// offset : position relative to the parent joint, in the parent's space (ofNode::getPosition)
+		// limits are euler radians
+		JointID addJoint(JointID parent
+			, const glm::vec3 & offset
+			, const glm::vec3 & lowerLimit = glm::vec3(-glm::pi<float>())
+			, const glm::vec3 & upperLimit = glm::vec3(glm::pi<float>())) {
+			Joint joint;
+			joint.parent = parent;
+			joint.offset = offset;
+			joint.lowerLimit = lowerLimit;
+			joint.upperLimit = upperLimit;
+			for (auto & angle : joint.angles) {
+				angle = 0.0;
+			}
+			this->joints.push_back(joint);
+			return (JointID) this->joints.size() - 1;
+		}
+
+		//----------
+		size_t getJointCount() const {
+			return this->joints.size();
+		}
+
+		//----------
+		void setSettings(const Settings & settings) {
+			this->settings = settings;
+		}
+
+		//----------
+		// World transform of the root joint's parent
+		void setRootTransform(const glm::mat4 & rootTransform) {
+			this->rootTransform = rootTransform;
+		}
+
+		//----------
+		void setTarget(JointID joint, const glm::vec3 & worldPosition, float weight = 1.0f) {
+			for (auto & target : this->targets) {
+				if (target.joint == joint) {
+					target.position = worldPosition;
+					target.weight = weight;
+					return;
+				}
+			}
+			this->targets.push_back({ joint, worldPosition, weight });
+		}
+
+		//----------
+		void clearTargets() {
+			this->targets.clear();
+		}
+
+		//----------
+		// Euler radians
+		void setJointAngles(JointID joint, const glm::vec3 & angles) {
+			for (int i = 0; i < 3; i++) {
+				this->joints[joint].angles[i] = angles[i];
+			}
+		}
+
+		//----------
+		glm::vec3 getJointAngles(JointID joint) const {
+			const auto & angles = this->joints[joint].angles;
+			return glm::vec3(angles[0], angles[1], angles[2]);
+		}
+
+		//----------
+		// For ofNode::setOrientation
+		glm::quat getLocalOrientation(JointID joint) const {
+			const auto & angles = this->joints[joint].angles;
+			return glm::quat(VectorMath::eulerToQuat(glm::tvec3<double>(angles[0], angles[1], angles[2])));
+		}
+
+		//----------
+		glm::mat4 getGlobalTransform(JointID joint) const {
+			auto transform = glm::tmat4x4<double>(this->getLocalTransform(joint));
+			for (auto parent = this->joints[joint].parent; parent >= 0; parent = this->joints[parent].parent) {
+				transform = this->getLocalTransform(parent) * transform;
+			}
+			return glm::mat4(glm::tmat4x4<double>(this->rootTransform) * transform);
+		}
+
+		//----------
+		ceres::Solver::Summary solve() {
+			ceres::Problem problem;
+			std::set<JointID> usedJoints;
+
+			for (const auto & target : this->targets) {
+				std::vector<JointID> chain;
+				for (auto parent = this->joints[target.joint].parent; parent >= 0; parent = this->joints[parent].parent) {
+					chain.push_back(parent);
+				}
+				if (chain.empty()) {
+					continue;
+				}
+				std::reverse(chain.begin(), chain.end());
+
+				std::vector<glm::tvec3<double>> chainOffsets;
+				std::vector<double *> parameterBlocks;
+				for (auto joint : chain) {
+					chainOffsets.push_back(this->joints[joint].offset);
+					parameterBlocks.push_back(this->joints[joint].angles);
+				}
+
+				// single threaded solve, so one scratch slot
+				auto costFunction = new PreallocatedAutoDiffCostFunction<IKChainError>(new IKChainError(glm::tmat4x4<double>(this->rootTransform)
+					, chainOffsets
+					, this->joints[target.joint].offset
+					, target.position
+					, target.weight)
+					, std::vector<int>(parameterBlocks.size(), 3)
+					, 3
+					, 1);
+				problem.AddResidualBlock(costFunction, NULL, parameterBlocks);
+
+				usedJoints.insert(chain.begin(), chain.end());
+			}
+
+			for (auto jointID : usedJoints) {
+				auto & joint = this->joints[jointID];
+
+				std::vector<int> lockedAxes;
+				for (int i = 0; i < 3; i++) {
+					if (joint.lowerLimit[i] >= joint.upperLimit[i]) {
+						joint.angles[i] = joint.lowerLimit[i];
+						lockedAxes.push_back(i);
+					}
+					else {
+						// bounds require a feasible starting point
+						joint.angles[i] = std::min(std::max(joint.angles[i], (double) joint.lowerLimit[i]), (double) joint.upperLimit[i]);
+						problem.SetParameterLowerBound(joint.angles, i, joint.lowerLimit[i]);
+						problem.SetParameterUpperBound(joint.angles, i, joint.upperLimit[i]);
+					}
+				}
+
+				if (lockedAxes.size() == 3) {
+					problem.SetParameterBlockConstant(joint.angles);
+				}
+				else if (!lockedAxes.empty()) {
+					problem.SetParameterization(joint.angles, new ceres::SubsetParameterization(3, lockedAxes));
+				}
+			}
+
+			ceres::Solver::Summary summary;
+			if (problem.NumResidualBlocks() == 0) {
+				return summary;
+			}
+
+			ceres::Solver::Options options;
+			options.linear_solver_type = ceres::DENSE_QR;
+			options.max_num_iterations = this->settings.maxIterations;
+			options.function_tolerance = this->settings.functionTolerance;
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+			ceres::Solve(options, &problem, &summary);
+			return summary;
+		}
+
+		//----------
+		// Solve every skeleton of a scene, one skeleton per task.
+		static void solve(const std::vector<IKSkeleton *> & skeletons, ThreadPool & threadPool = ThreadPool::getShared()) {
+			threadPool.parallelFor(skeletons.size(), [&skeletons](size_t i) {
+				skeletons[i]->solve();
+			});
+		}
+
+	protected:
+		struct Joint {
+			JointID parent;
+			glm::vec3 offset;
+			glm::vec3 lowerLimit;
+			glm::vec3 upperLimit;
+			double angles[3]; // parameter block
+		};
+
+		struct Target {
+			JointID joint;
+			glm::vec3 position;
+			float weight;
+		};
+
+		//----------
+		glm::tmat4x4<double> getLocalTransform(JointID jointID) const {
+			const auto & joint = this->joints[jointID];
+			return VectorMath::createTransform(glm::tvec3<double>(joint.offset)
+				, glm::tvec3<double>(joint.angles[0], joint.angles[1], joint.angles[2]));
+		}
+
+		Settings settings;
+		glm::mat4 rootTransform = glm::mat4(1.0f);
+
+		// the problem is rebuilt every solve, so joints may reallocate between solves
+		std::vector<Joint> joints;
+		std::vector<Target> targets;
+	};
+}
@@ -0,0 +1,523 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+
+#include "ofPixels.h"
+
+#include <ceres/cubic_interpolation.h>
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Zero copy ceres::Grid2D over ofPixels_ (ofFloatPixels, ofShortPixels, ofPixels)
+	// for use with ceres::BiCubicInterpolator. Channels must match the pixels' channel count.
+	// The pixels must outlive the grid.
+	template<typename PixelType, int Channels = 1>
+	struct PixelsGrid : public ceres::Grid2D<PixelType, Channels> {
+		PixelsGrid(const ofPixels_<PixelType> & pixels)
+			: ceres::Grid2D<PixelType, Channels>(pixels.getData()
+				, 0, (int) pixels.getHeight()
+				, 0, (int) pixels.getWidth()) {
+			CHECK_EQ((int) pixels.getNumChannels(), Channels);
+		}
+	};
+
+	//----------
+	namespace ImageAlignment {
+		//----------
+		inline double scalarPart(double x) {
+			return x;
+		}
+
+		//----------
+		template<typename T, int N>
+		double scalarPart(const ceres::Jet<T, N> & x) {
+			return x.a;
+		}
+	}
+
+	//----------
+	// One channel float image pyramid with precomputed central difference gradients.
+	// Each level halves the previous with a 2x2 box filter. Level 0 points straight
+	// into the source pixels when they are already 1 channel float.
+	//
+	// Alignment samples the levels bilinearly with the precomputed gradients rather
+	// than through ceres::BiCubicInterpolator, which would fit 16 taps and
+	// differentiate the cubic for every sample and every evaluation. getGrid() and
+	// PixelsGrid are there for cost functions which want BiCubicInterpolator.
+	class ImagePyramid {
+	public:
+		struct Level {
+			int width = 0;
+			int height = 0;
+			const float * image = nullptr;
+			std::vector<float> storage; // empty when image points at the source pixels
+			std::vector<float> gradientX;
+			std::vector<float> gradientY;
+
+			//----------
+			Level() {}
+
+			//----------
+			// image must follow storage into the copy
+			Level(const Level & other)
+				: width(other.width)
+				, height(other.height)
+				, image(other.image)
+				, storage(other.storage)
+				, gradientX(other.gradientX)
+				, gradientY(other.gradientY) {
+				if (!this->storage.empty()) {
+					this->image = this->storage.data();
+				}
+			}
+
+			//----------
+			Level & operator=(const Level & other) {
+				this->width = other.width;
+				this->height = other.height;
+				this->storage = other.storage;
+				this->gradientX = other.gradientX;
+				this->gradientY = other.gradientY;
+				this->image = this->storage.empty() ? other.image : this->storage.data();
+				return *this;
+			}
+
+			// moving a vector keeps its buffer, so image stays valid
+			Level(Level &&) = default;
+			Level & operator=(Level &&) = default;
+
+			//----------
+			ceres::Grid2D<float> getGrid() const {
+				return ceres::Grid2D<float>(this->image, 0, this->height, 0, this->width);
+			}
+
+			//----------
+			ceres::Grid2D<float> getGradientXGrid() const {
+				return ceres::Grid2D<float>(this->gradientX.data(), 0, this->height, 0, this->width);
+			}
+
+			//----------
+			ceres::Grid2D<float> getGradientYGrid() const {
+				return ceres::Grid2D<float>(this->gradientY.data(), 0, this->height, 0, this->width);
+			}
+
+			//----------
+			float getPixel(int x, int y) const {
+				return this->image[y * this->width + x];
+			}
+
+			//----------
+			// Bilinear image value and gradient at a position in pixels. Positions outside
+			// the image are clamped to the border.
+			void sample(double x, double y, double & value, double & dx, double & dy) const {
+				x = std::min(std::max(x, 0.0), (double) (this->width - 1));
+				y = std::min(std::max(y, 0.0), (double) (this->height - 1));
+				const int x0 = std::min((int) x, std::max(this->width - 2, 0));
+				const int y0 = std::min((int) y, std::max(this->height - 2, 0));
+				const int x1 = std::min(x0 + 1, this->width - 1);
+				const int y1 = std::min(y0 + 1, this->height - 1);
+				const double fx = x - x0;
+				const double fy = y - y0;
+
+				const int i00 = y0 * this->width + x0;
+				const int i01 = y0 * this->width + x1;
+				const int i10 = y1 * this->width + x0;
+				const int i11 = y1 * this->width + x1;
+				const double w00 = (1.0 - fx) * (1.0 - fy);
+				const double w01 = fx * (1.0 - fy);
+				const double w10 = (1.0 - fx) * fy;
+				const double w11 = fx * fy;
+
+				value = w00 * this->image[i00] + w01 * this->image[i01] + w10 * this->image[i10] + w11 * this->image[i11];
+				dx = w00 * this->gradientX[i00] + w01 * this->gradientX[i01] + w10 * this->gradientX[i10] + w11 * this->gradientX[i11];
+				dy = w00 * this->gradientY[i00] + w01 * this->gradientY[i01] + w10 * this->gradientY[i10] + w11 * this->gradientY[i11];
+			}
+
+			//----------
+			double sample(double x, double y) const {
+				double value, dx, dy;
+				this->sample(x, y, value, dx, dy);
+				return value;
+			}
+
+			//----------
+			// Jets take their derivative from the precomputed gradient images
+			// instead of differencing neighbouring samples every evaluation.
+			template<typename T, int N>
+			ceres::Jet<T, N> sample(const ceres::Jet<T, N> & x, const ceres::Jet<T, N> & y) const {
+				double value, dx, dy;
+				this->sample(x.a, y.a, value, dx, dy);
+				ceres::Jet<T, N> result;
+				result.a = value;
+				result.v = dx * x.v + dy * y.v;
+				return result;
+			}
+		};
+
+		//----------
+		// Integer pixels are normalized to 0..1 to match ofFloatPixels.
+		template<typename PixelType>
+		void build(const ofPixels_<PixelType> & pixels, int levelCount) {
+			const int width = (int) pixels.getWidth();
+			const int height = (int) pixels.getHeight();
+			const int channels = (int) pixels.getNumChannels();
+
+			this->levels.resize(std::max(1, levelCount));
+
+			auto & base = this->levels[0];
+			base.width = width;
+			base.height = height;
+			if (std::is_same<PixelType, float>::value && channels == 1) {
+				base.storage.clear();
+				base.image = (const float *) pixels.getData();
+			}
+			else {
+				const float scale = std::is_integral<PixelType>::value
+					? 1.0f / (float) std::numeric_limits<PixelType>::max() / (float) channels
+					: 1.0f / (float) channels;
+				const auto data = pixels.getData();
+				base.storage.resize(width * height);
+				for (int i = 0; i < width * height; i++) {
+					float sum = 0.0f;
+					for (int c = 0; c < channels; c++) {
+						sum += (float) data[i * channels + c];
+					}
+					base.storage[i] = sum * scale;
+				}
+				base.image = base.storage.data();
+			}
+			computeGradients(base);
+
+			for (size_t i = 1; i < this->levels.size(); i++) {
+				const auto & previous = this->levels[i - 1];
+				auto & level = this->levels[i];
+				level.width = std::max(1, previous.width / 2);
+				level.height = std::max(1, previous.height / 2);
+				level.storage.resize(level.width * level.height);
+				for (int y = 0; y < level.height; y++) {
+					const int y0 = std::min(2 * y, previous.height - 1);
+					const int y1 = std::min(2 * y + 1, previous.height - 1);
+					for (int x = 0; x < level.width; x++) {
+						const int x0 = std::min(2 * x, previous.width - 1);
+						const int x1 = std::min(2 * x + 1, previous.width - 1);
+						level.storage[y * level.width + x] = 0.25f * (previous.getPixel(x0, y0)
+							+ previous.getPixel(x1, y0)
+							+ previous.getPixel(x0, y1)
+							+ previous.getPixel(x1, y1));
+					}
+				}
+				level.image = level.storage.data();
+				computeGradients(level);
+			}
+		}
+
+		//----------
+		size_t getLevelCount() const {
+			return this->levels.size();
+		}
+
+		//----------
+		const Level & getLevel(size_t index) const {
+			return this->levels[index];
+		}
+
+	protected:
+		//----------
+		static void computeGradients(Level & level) {
+			const int width = level.width;
+			const int height = level.height;
+			level.gradientX.resize(width * height);
+			level.gradientY.resize(width * height);
+			for (int y = 0; y < height; y++) {
+				const int up = std::max(y - 1, 0);
+				const int down = std::min(y + 1, height - 1);
+				for (int x = 0; x < width; x++) {
+					const int left = std::max(x - 1, 0);
+					const int right = std::min(x + 1, width - 1);
+					const int index = y * width + x;
+					level.gradientX[index] = right > left ? (level.getPixel(right, y) - level.getPixel(left, y)) / (float) (right - left) : 0.0f;
+					level.gradientY[index] = down > up ? (level.getPixel(x, down) - level.getPixel(x, up)) / (float) (down - up) : 0.0f;
+				}
+			}
+		}
+
+		std::vector<Level> levels;
+	};
+
+	//----------
+	// Warps map template pixel coordinates into image pixel coordinates. Parameters
+	// are the row major entries of the 3x3 matrix, as in Homography.
+	struct AffineWarp {
+		enum { NumParameters = 6 };
+
+		//----------
+		template<typename T>
+		static void apply(const T * const p, double x, double y, T & u, T & v) {
+			u = p[0] * x + p[1] * y + p[2];
+			v = p[3] * x + p[4] * y + p[5];
+		}
+
+		//----------
+		static Eigen::Matrix3d toMatrix(const double * p) {
+			Eigen::Matrix3d matrix;
+			matrix << p[0], p[1], p[2]
+				, p[3], p[4], p[5]
+				, 0.0, 0.0, 1.0;
+			return matrix;
+		}
+
+		//----------
+		static void fromMatrix(const Eigen::Matrix3d & matrix, double * p) {
+			for (int i = 0; i < 6; i++) {
+				p[i] = matrix(i / 3, i % 3) / matrix(2, 2);
+			}
+		}
+	};
+
+	//----------
+	struct HomographyWarp {
+		enum { NumParameters = 8 };
+
+		//----------
+		template<typename T>
+		static void apply(const T * const p, double x, double y, T & u, T & v) {
+			const T w = p[6] * x + p[7] * y + 1.0;
+			u = (p[0] * x + p[1] * y + p[2]) / w;
+			v = (p[3] * x + p[4] * y + p[5]) / w;
+		}
+
+		//----------
+		static Eigen::Matrix3d toMatrix(const double * p) {
+			Eigen::Matrix3d matrix;
+			matrix << p[0], p[1], p[2]
+				, p[3], p[4], p[5]
+				, p[6], p[7], 1.0;
+			return matrix;
+		}
+
+		//----------
+		static void fromMatrix(const Eigen::Matrix3d & matrix, double * p) {
+			for (int i = 0; i < 8; i++) {
+				p[i] = matrix(i / 3, i % 3) / matrix(2, 2);
+			}
+		}
+	};
+
+	//----------
+	// Rotation, uniform scale and translation. Parameters are (a, b, tx, ty) of
+	// the matrix [a -b tx; b a ty; 0 0 1].
+	struct SimilarityWarp {
+		enum { NumParameters = 4 };
+
+		//----------
+		template<typename T>
+		static void apply(const T * const p, double x, double y, T & u, T & v) {
+			u = p[0] * x - p[1] * y + p[2];
+			v = p[1] * x + p[0] * y + p[3];
+		}
+
+		//----------
+		static Eigen::Matrix3d toMatrix(const double * p) {
+			Eigen::Matrix3d matrix;
+			matrix << p[0], -p[1], p[2]
+				, p[1], p[0], p[3]
+				, 0.0, 0.0, 1.0;
+			return matrix;
+		}
+
+		//----------
+		static void fromMatrix(const Eigen::Matrix3d & matrix, double * p) {
+			p[0] = matrix(0, 0) / matrix(2, 2);
+			p[1] = matrix(1, 0) / matrix(2, 2);
+			p[2] = matrix(0, 2) / matrix(2, 2);
+			p[3] = matrix(1, 2) / matrix(2, 2);
+		}
+	};
+
+	//----------
+	// Intensity difference between template samples and the warped image for a
+	// batch of samples, so one residual block covers many pixels.
+	// Samples warped outside the image contribute zero.
+	template<typename Warp>
+	struct PhotometricAlignmentError {
+		struct Sample {
+			float x;
+			float y;
+			float value;
+		};
+
+		PhotometricAlignmentError(const ImagePyramid::Level & image, const Sample * samples, size_t count)
+			: image(image)
+			, samples(samples)
+			, count(count) {}
+
+		template <typename T>
+		bool operator()(const T * const warpParameters
+			, T * residuals) const {
+			const double maxX = this->image.width - 1;
+			const double maxY = this->image.height - 1;
+			for (size_t i = 0; i < this->count; i++) {
+				const auto & sample = this->samples[i];
+				T u, v;
+				Warp::apply(warpParameters, sample.x, sample.y, u, v);
+
+				const double x = ImageAlignment::scalarPart(u);
+				const double y = ImageAlignment::scalarPart(v);
+				if (x < 0.0 || y < 0.0 || x > maxX || y > maxY) {
+					residuals[i] = T(0.0);
+					continue;
+				}
+
+				residuals[i] = this->image.sample(u, v) - (double) sample.value;
+			}
+			return true;
+		}
+
+		const ImagePyramid::Level & image;
+		const Sample * samples;
+		size_t count;
+	};
+
+	//----------
+	// Direct (photometric) alignment of a template image into an image, coarse to fine
+	// over image pyramids. Parameters are kept between calls so video frames warm start
+	// from the previous alignment.
+	template<typename Warp>
+	class ImageAligner {
+	public:
+		typedef typename PhotometricAlignmentError<Warp>::Sample Sample;
+
+		struct Settings {
+			int levels = 4;
+			int maxIterationsPerLevel = 10;
+
+			// only template pixels with at least this gradient magnitude are used
+			float minimumGradient = 0.0f;
+
+			// residuals per residual block
+			size_t samplesPerBlock = 256;
+		};
+
+		//----------
+		ImageAligner() {
+			this->reset();
+		}
+
+		//----------
+		void setSettings(const Settings & settings) {
+			this->settings = settings;
+		}
+
+		//----------
+		// Back to the identity warp
+		void reset() {
+			for (int i = 0; i < Warp::NumParameters; i++) {
+				this->parameters[i] = (i == 0 || i == 4) ? 1.0 : 0.0;
+			}
+		}
+
+		//----------
+		template<typename PixelType>
+		void setTemplate(const ofPixels_<PixelType> & templatePixels) {
+			ImagePyramid templatePyramid;
+			templatePyramid.build(templatePixels, this->settings.levels);
+
+			this->samples.resize(templatePyramid.getLevelCount());
+			const float minimumGradient2 = this->settings.minimumGradient * this->settings.minimumGradient;
+			for (size_t i = 0; i < this->samples.size(); i++) {
+				const auto & level = templatePyramid.getLevel(i);
+				auto & levelSamples = this->samples[i];
+				levelSamples.clear();
+				for (int y = 0; y < level.height; y++) {
+					for (int x = 0; x < level.width; x++) {
+						const int index = y * level.width + x;
+						const float gx = level.gradientX[index];
+						const float gy = level.gradientY[index];
+						if (gx * gx + gy * gy >= minimumGradient2) {
+							levelSamples.push_back({ (float) x, (float) y, level.image[index] });
+						}
+					}
+				}
+			}
+		}
+
+		//----------
+		// Template must be set first. The pixels must stay alive during the call.
+		template<typename PixelType>
+		ceres::Solver::Summary align(const ofPixels_<PixelType> & imagePixels) {
+			ceres::Solver::Summary summary;
+			if (this->samples.empty()) {
+				return summary;
+			}
+
+			this->imagePyramid.build(imagePixels, (int) this->samples.size());
+
+			ceres::Solver::Options options;
+			options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = this->settings.maxIterationsPerLevel;
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+
+			for (int levelIndex = (int) this->samples.size() - 1; levelIndex >= 0; levelIndex--) {
+				const auto & levelSamples = this->samples[levelIndex];
+				if (levelSamples.empty()) {
+					continue;
+				}
+
+				// pixel centres of level l sit at 2^l (x + 0.5) - 0.5 in level 0
+				const double scale = (double) (1 << levelIndex);
+				const double offset = 0.5 * (scale - 1.0);
+				Eigen::Matrix3d levelToBase;
+				levelToBase << scale, 0.0, offset
+					, 0.0, scale, offset
+					, 0.0, 0.0, 1.0;
+
+				double levelParameters[Warp::NumParameters];
+				Warp::fromMatrix(levelToBase.inverse() * Warp::toMatrix(this->parameters) * levelToBase, levelParameters);
+
+				const auto & imageLevel = this->imagePyramid.getLevel(levelIndex);
+				ceres::Problem problem;
+				const size_t samplesPerBlock = std::max<size_t>(this->settings.samplesPerBlock, 1);
+				for (size_t begin = 0; begin < levelSamples.size(); begin += samplesPerBlock) {
+					const size_t count = std::min(samplesPerBlock, levelSamples.size() - begin);
+					auto costFunction = new ceres::AutoDiffCostFunction<PhotometricAlignmentError<Warp>, ceres::DYNAMIC, Warp::NumParameters>(
+						new PhotometricAlignmentError<Warp>(imageLevel, levelSamples.data() + begin, count)
+						, (int) count);
+					problem.AddResidualBlock(costFunction, NULL, levelParameters);
+				}
+				ceres::Solve(options, &problem, &summary);
+
+				Warp::fromMatrix(levelToBase * Warp::toMatrix(levelParameters) * levelToBase.inverse(), this->parameters);
+			}
+
+			return summary;
+		}
+
+		//----------
+		// Template pixel coordinates to image pixel coordinates
+		glm::mat3 getMatrix() const {
+			const auto matrix = Warp::toMatrix(this->parameters);
+			glm::mat3 result;
+			for (int column = 0; column < 3; column++) {
+				for (int row = 0; row < 3; row++) {
+					result[column][row] = matrix(row, column);
+				}
+			}
+			return result;
+		}
+
+		double parameters[Warp::NumParameters];
+
+	protected:
+		Settings settings;
+		ImagePyramid imagePyramid;
+		std::vector<std::vector<Sample>> samples; // per level
+	};
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include "CeresSolverThreadPool.h"
+
+#include "ofVectorMath.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Bucketed 3D KD-tree for nearest neighbour search.
+	// Nodes live in one flat array with siblings stored next to each other.
+	// Leaves hold up to leafSize points, and the points are stored as separate
+	// x / y / z arrays ordered by leaf, so each leaf scan reads contiguous memory.
+	class KdTree {
+	public:
+		struct Result {
+			uint32_t index; // index into the vector passed to build()
+			float distance2;
+		};
+
+		//----------
+		void build(const std::vector<glm::vec3> & points, size_t leafSize = 16) {
+			this->clear();
+			if (points.empty()) {
+				return;
+			}
+
+			this->leafSize = std::max((size_t) 1, leafSize);
+			this->indices.resize(points.size());
+			std::iota(this->indices.begin(), this->indices.end(), 0);
+
+			this->nodes.reserve(2 * (points.size() / this->leafSize + 1));
+			this->nodes.push_back(Node());
+			this->buildNode(0, 0, (uint32_t) points.size(), points);
+
+			this->x.resize(points.size());
+			this->y.resize(points.size());
+			this->z.resize(points.size());
+			for (size_t i = 0; i < points.size(); i++) {
+				const auto & point = points[this->indices[i]];
+				this->x[i] = point.x;
+				this->y[i] = point.y;
+				this->z[i] = point.z;
+			}
+		}
+
+		//----------
+		void clear() {
+			this->nodes.clear();
+			this->indices.clear();
+			this->x.clear();
+			this->y.clear();
+			this->z.clear();
+		}
+
+		//----------
+		bool empty() const {
+			return this->indices.empty();
+		}
+
+		//----------
+		size_t size() const {
+			return this->indices.size();
+		}
+
+		//----------
+		// Returns false if no point lies within maxDistance2.
+		bool findNearest(const glm::vec3 & query
+			, Result & result
+			, float maxDistance2 = std::numeric_limits<float>::max()) const {
+			if (this->empty()) {
+				return false;
+			}
+
+			const float q[3] = { query.x, query.y, query.z };
+			float best = maxDistance2;
+			uint32_t bestSlot = std::numeric_limits<uint32_t>::max();
+
+			StackEntry stack[MaxDepth];
+			int stackSize = 0;
+			stack[stackSize++] = { 0, 0.0f };
+
+			while (stackSize > 0) {
+				const auto entry = stack[--stackSize];
+				if (entry.distance2 >= best) {
+					continue;
+				}
+
+				const auto & node = this->nodes[entry.node];
+				if (node.axis < 0) {
+					const auto end = node.first + node.count;
+					for (uint32_t i = node.first; i < end; i++) {
+						const float dx = this->x[i] - q[0];
+						const float dy = this->y[i] - q[1];
+						const float dz = this->z[i] - q[2];
+						const float distance2 = dx * dx + dy * dy + dz * dz;
+						if (distance2 < best) {
+							best = distance2;
+							bestSlot = i;
+						}
+					}
+				}
+				else {
+					const float delta = q[node.axis] - node.split;
+					const uint32_t nearChild = delta < 0.0f ? node.first : node.first + 1;
+					const uint32_t farChild = delta < 0.0f ? node.first + 1 : node.first;
+
+					// far side first so the near side is popped next
+					stack[stackSize++] = { farChild, std::max(entry.distance2, delta * delta) };
+					stack[stackSize++] = { nearChild, entry.distance2 };
+				}
+			}
+
+			if (bestSlot == std::numeric_limits<uint32_t>::max()) {
+				return false;
+			}
+			result.index = this->indices[bestSlot];
+			result.distance2 = best;
+			return true;
+		}
+
+		//----------
+		// Fills results with up to k neighbours sorted by increasing distance.
+		size_t findKNearest(const glm::vec3 & query
+			, size_t k
+			, std::vector<Result> & results
+			, float maxDistance2 = std::numeric_limits<float>::max()) const {
+			results.clear();
+			if (this->empty() || k == 0) {
+				return 0;
+			}
+
+			const float q[3] = { query.x, query.y, query.z };
+			auto farther = [](const Result & a, const Result & b) {
+				return a.distance2 < b.distance2;
+			};
+			auto bound = [&]() {
+				return results.size() < k ? maxDistance2 : results.front().distance2;
+			};
+
+			StackEntry stack[MaxDepth];
+			int stackSize = 0;
+			stack[stackSize++] = { 0, 0.0f };
+
+			while (stackSize > 0) {
+				const auto entry = stack[--stackSize];
+				if (entry.distance2 >= bound()) {
+					continue;
+				}
+
+				const auto & node = this->nodes[entry.node];
+				if (node.axis < 0) {
+					const auto end = node.first + node.count;
+					for (uint32_t i = node.first; i < end; i++) {
+						const float dx = this->x[i] - q[0];
+						const float dy = this->y[i] - q[1];
+						const float dz = this->z[i] - q[2];
+						const float distance2 = dx * dx + dy * dy + dz * dz;
+						if (distance2 < bound()) {
+							// results is a max-heap on distance while searching
+							if (results.size() == k) {
+								std::pop_heap(results.begin(), results.end(), farther);
+								results.pop_back();
+							}
+							results.push_back({ i, distance2 });
+							std::push_heap(results.begin(), results.end(), farther);
+						}
+					}
+				}
+				else {
+					const float delta = q[node.axis] - node.split;
+					const uint32_t nearChild = delta < 0.0f ? node.first : node.first + 1;
+					const uint32_t farChild = delta < 0.0f ? node.first + 1 : node.first;
+					stack[stackSize++] = { farChild, std::max(entry.distance2, delta * delta) };
+					stack[stackSize++] = { nearChild, entry.distance2 };
+				}
+			}
+
+			std::sort_heap(results.begin(), results.end(), farther);
+			for (auto & result : results) {
+				result.index = this->indices[result.index];
+			}
+			return results.size();
+		}
+
+		//----------
+		// Nearest neighbour for every query, spread over the thread pool.
+		// Queries without a neighbour inside maxDistance2 get index = NotFound.
+		void findNearest(const std::vector<glm::vec3> & queries
+			, std::vector<Result> & results
+			, float maxDistance2 = std::numeric_limits<float>::max()
+			, ThreadPool & threadPool = ThreadPool::getShared()) const {
+			results.resize(queries.size());
+			threadPool.parallelFor(queries.size(), [&](size_t i) {
+				if (!this->findNearest(queries[i], results[i], maxDistance2)) {
+					results[i].index = NotFound;
+					results[i].distance2 = std::numeric_limits<float>::max();
+				}
+			});
+		}
+
+		static const uint32_t NotFound = std::numeric_limits<uint32_t>::max();
+
+	protected:
+		// 16 bytes, 4 nodes per cache line
+		struct Node {
+			float split = 0.0f;
+			int32_t axis = -1; // -1 for a leaf
+			uint32_t first = 0; // leaf : first point slot. inner : index of left child, right child follows
+			uint32_t count = 0; // leaf : number of points
+		};
+
+		struct StackEntry {
+			uint32_t node;
+			float distance2; // lower bound of the distance to anything in the node
+		};
+
+		// each level pushes 2 and pops 1, so this covers trees far deeper than 2^32 points need
+		static const int MaxDepth = 128;
+
+		//----------
+		void buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, const std::vector<glm::vec3> & points) {
+			const uint32_t count = end - begin;
+			if (count <= this->leafSize) {
+				auto & node = this->nodes[nodeIndex];
+				node.axis = -1;
+				node.first = begin;
+				node.count = count;
+				return;
+			}
+
+			// split the widest axis at the median
+			glm::vec3 minimum(std::numeric_limits<float>::max());
+			glm::vec3 maximum(-std::numeric_limits<float>::max());
+			for (uint32_t i = begin; i < end; i++) {
+				const auto & point = points[this->indices[i]];
+				for (int axis = 0; axis < 3; axis++) {
+					minimum[axis] = std::min(minimum[axis], point[axis]);
+					maximum[axis] = std::max(maximum[axis], point[axis]);
+				}
+			}
+			int axis = 0;
+			for (int i = 1; i < 3; i++) {
+				if (maximum[i] - minimum[i] > maximum[axis] - minimum[axis]) {
+					axis = i;
+				}
+			}
+
+			const uint32_t middle = begin + count / 2;
+			std::nth_element(this->indices.begin() + begin
+				, this->indices.begin() + middle
+				, this->indices.begin() + end
+				, [&points, axis](uint32_t a, uint32_t b) {
+				return points[a][axis] < points[b][axis];
+			});
+
+			const uint32_t leftChild = (uint32_t) this->nodes.size();
+			this->nodes.push_back(Node());
+			this->nodes.push_back(Node());
+			{
+				// nodes may have reallocated
+				auto & node = this->nodes[nodeIndex];
+				node.axis = axis;
+				node.split = points[this->indices[middle]][axis];
+				node.first = leftChild;
+			}
+
+			this->buildNode(leftChild, begin, middle, points);
+			this->buildNode(leftChild + 1, middle, end, points);
+		}
+
+		std::vector<Node> nodes;
+		std::vector<uint32_t> indices; // slot -> original index
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		size_t leafSize = 16;
+	};
+}
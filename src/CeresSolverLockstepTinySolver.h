@@ -0,0 +1,325 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <limits>
+
+namespace ofxCeresSolver {
+	//----------
+	// ceres::TinySolver over Lanes independent problems of the same shape at once
+	// (per fixture aiming, per LED triangulation, ...). Every scalar of the solve is
+	// an Eigen::Array<double, Lanes, 1>, so the Levenberg-Marquardt bookkeeping,
+	// normal equations and their factorization run as packed SIMD across problems
+	// (4 lanes fill an AVX register of doubles, 8 lanes two of them or one AVX-512).
+	// The steps follow TinySolver: Jacobi scaling, the same trust region update
+	// and the same stopping tests, decided per lane. Lanes which have stopped are
+	// masked out and keep their result while the others continue.
+	//
+	// The Function has fixed NUM_RESIDUALS and NUM_PARAMETERS and evaluates all
+	// lanes in one call, with a column major Jacobian as TinySolver:
+	//	bool operator()(const Lane * parameters, Lane * residuals, Lane * jacobian) const;
+	// Existing TinySolver functions (e.g. ceres::TinySolverAutoDiffFunction) can be
+	// used through LockstepLaneAdapter, which evaluates them lane by lane.
+	template<typename Function, int Lanes = 4>
+	class LockstepTinySolver {
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		enum {
+			NUM_RESIDUALS = Function::NUM_RESIDUALS,
+			NUM_PARAMETERS = Function::NUM_PARAMETERS
+		};
+
+		typedef Eigen::Array<double, Lanes, 1> Lane;
+		typedef Eigen::Array<bool, Lanes, 1> Mask;
+
+		enum Status {
+			GRADIENT_TOO_SMALL,
+			RELATIVE_STEP_SIZE_TOO_SMALL,
+			COST_TOO_SMALL,
+			HIT_MAX_ITERATIONS
+		};
+
+		struct Options {
+			double gradient_tolerance = 1e-10;
+			double parameter_tolerance = 1e-8;
+			double cost_threshold = std::numeric_limits<double>::epsilon();
+			double initial_trust_region_radius = 1e4;
+			int max_num_iterations = 50;
+		};
+
+		// per lane
+		struct Summary {
+			EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+			Lane initial_cost;
+			Lane final_cost;
+			Lane gradient_max_norm;
+			Eigen::Array<int, Lanes, 1> iterations;
+			Eigen::Array<int, Lanes, 1> status;
+		};
+
+		//----------
+		// parameters holds NUM_PARAMETERS lanes and is updated in place
+		const Summary & solve(const Function & function, Lane * parameters) {
+			Lane * x = parameters;
+			this->summary.iterations.setZero();
+			this->summary.status.setConstant(HIT_MAX_ITERATIONS);
+
+			Mask all;
+			all.setConstant(true);
+			this->update(function, x, all, true);
+			this->summary.initial_cost = this->cost;
+
+			Mask active = !this->stopAtSolution(all);
+
+			Lane u = Lane::Constant(1.0 / this->options.initial_trust_region_radius);
+			Lane v = Lane::Constant(2.0);
+
+			for (int iteration = 1; iteration < this->options.max_num_iterations && active.any(); iteration++) {
+				this->summary.iterations = active.select(iteration, this->summary.iterations);
+
+				// (JtJ + u D) step = g, with D the clamped diagonal of JtJ
+				for (int i = 0; i < NUM_PARAMETERS; i++) {
+					for (int j = 0; j < NUM_PARAMETERS; j++) {
+						this->regularized[i][j] = this->jtj[i][j];
+					}
+					this->regularized[i][i] += u * this->jtj[i][i].max(1e-6).min(1e32);
+				}
+				this->solveRegularized();
+
+				Lane xNorm2 = Lane::Zero();
+				Lane dxNorm2 = Lane::Zero();
+				for (int i = 0; i < NUM_PARAMETERS; i++) {
+					this->dx[i] = this->jacobiScaling[i] * this->step[i];
+					xNorm2 += x[i] * x[i];
+					dxNorm2 += this->dx[i] * this->dx[i];
+				}
+				const Lane parameterTolerance = this->options.parameter_tolerance * (xNorm2.sqrt() + this->options.parameter_tolerance);
+				const Mask smallStep = active && (dxNorm2.sqrt() < parameterTolerance);
+				this->summary.status = smallStep.select((int) RELATIVE_STEP_SIZE_TOO_SMALL, this->summary.status);
+				active = active && !smallStep;
+				if (!active.any()) {
+					break;
+				}
+
+				for (int i = 0; i < NUM_PARAMETERS; i++) {
+					this->xNew[i] = active.select(x[i] + this->dx[i], x[i]);
+				}
+				function(this->xNew, this->residualsNew, NULL);
+
+				Lane newCost2 = Lane::Zero();
+				for (int r = 0; r < NUM_RESIDUALS; r++) {
+					newCost2 += this->residualsNew[r] * this->residualsNew[r];
+				}
+				const Lane costChange = 2.0 * this->cost - newCost2;
+
+				Lane modelCostChange = Lane::Zero();
+				for (int i = 0; i < NUM_PARAMETERS; i++) {
+					Lane jtjStep = Lane::Zero();
+					for (int j = 0; j < NUM_PARAMETERS; j++) {
+						jtjStep += this->jtj[i][j] * this->step[j];
+					}
+					modelCostChange += this->step[i] * (2.0 * this->g[i] - jtjStep);
+				}
+				const Lane rho = costChange / modelCostChange;
+
+				const Mask accepted = active && (rho > 0.0);
+				const Mask rejected = active && !accepted;
+
+				if (accepted.any()) {
+					for (int i = 0; i < NUM_PARAMETERS; i++) {
+						x[i] = accepted.select(this->xNew[i], x[i]);
+					}
+					this->update(function, x, accepted, false);
+					active = active && !this->stopAtSolution(accepted);
+
+					const Lane tmp = 2.0 * rho - 1.0;
+					u = accepted.select(u * (1.0 - tmp * tmp * tmp).max(1.0 / 3.0), u);
+					v = accepted.select(Lane::Constant(2.0), v);
+				}
+
+				u = rejected.select(u * v, u);
+				v = rejected.select(v * 2.0, v);
+			}
+
+			this->summary.final_cost = this->cost;
+			return this->summary;
+		}
+
+		//----------
+		// Copies one scalar problem into / out of a lane
+		static void setLane(Lane * parameters, int lane, const double * values) {
+			for (int i = 0; i < NUM_PARAMETERS; i++) {
+				parameters[i][lane] = values[i];
+			}
+		}
+
+		//----------
+		static void getLane(const Lane * parameters, int lane, double * values) {
+			for (int i = 0; i < NUM_PARAMETERS; i++) {
+				values[i] = parameters[i][lane];
+			}
+		}
+
+		Options options;
+		Summary summary;
+
+	protected:
+		//----------
+		// Re-linearizes at x for the lanes in mask
+		void update(const Function & function, const Lane * x, const Mask & mask, bool first) {
+			function(x, this->residuals, this->jacobian);
+
+			if (first) {
+				// 1 / (1 + |column of J|), as TinySolver
+				for (int c = 0; c < NUM_PARAMETERS; c++) {
+					Lane norm2 = Lane::Zero();
+					for (int r = 0; r < NUM_RESIDUALS; r++) {
+						norm2 += this->jacobian[c * NUM_RESIDUALS + r] * this->jacobian[c * NUM_RESIDUALS + r];
+					}
+					this->jacobiScaling[c] = 1.0 / (1.0 + norm2.sqrt());
+				}
+			}
+
+			for (int c = 0; c < NUM_PARAMETERS; c++) {
+				for (int r = 0; r < NUM_RESIDUALS; r++) {
+					this->jacobian[c * NUM_RESIDUALS + r] *= this->jacobiScaling[c];
+				}
+			}
+
+			Lane cost = Lane::Zero();
+			for (int r = 0; r < NUM_RESIDUALS; r++) {
+				cost += this->residuals[r] * this->residuals[r];
+			}
+			this->cost = mask.select(0.5 * cost, this->cost);
+
+			Lane gradientMaxNorm = Lane::Zero();
+			for (int i = 0; i < NUM_PARAMETERS; i++) {
+				const Lane * Ji = this->jacobian + i * NUM_RESIDUALS;
+				Lane gi = Lane::Zero();
+				for (int r = 0; r < NUM_RESIDUALS; r++) {
+					// residuals are negated, as TinySolver
+					gi -= Ji[r] * this->residuals[r];
+				}
+				this->g[i] = mask.select(gi, this->g[i]);
+				gradientMaxNorm = gradientMaxNorm.max(gi.abs());
+
+				for (int j = i; j < NUM_PARAMETERS; j++) {
+					const Lane * Jj = this->jacobian + j * NUM_RESIDUALS;
+					Lane jtjij = Lane::Zero();
+					for (int r = 0; r < NUM_RESIDUALS; r++) {
+						jtjij += Ji[r] * Jj[r];
+					}
+					this->jtj[i][j] = mask.select(jtjij, this->jtj[i][j]);
+					this->jtj[j][i] = this->jtj[i][j];
+				}
+			}
+			this->summary.gradient_max_norm = mask.select(gradientMaxNorm, this->summary.gradient_max_norm);
+		}
+
+		//----------
+		// Lanes in mask which meet the gradient or cost test
+		Mask stopAtSolution(const Mask & mask) {
+			const Mask smallGradient = mask && (this->summary.gradient_max_norm < this->options.gradient_tolerance);
+			const Mask smallCost = mask && !smallGradient && (this->cost < this->options.cost_threshold);
+			this->summary.status = smallGradient.select((int) GRADIENT_TOO_SMALL, this->summary.status);
+			this->summary.status = smallCost.select((int) COST_TOO_SMALL, this->summary.status);
+			return smallGradient || smallCost;
+		}
+
+		//----------
+		// LDLt without pivoting, which is enough for the regularized normal equations
+		// and keeps every lane on the same instruction stream
+		void solveRegularized() {
+			auto & A = this->regularized;
+			Lane D[NUM_PARAMETERS];
+			for (int j = 0; j < NUM_PARAMETERS; j++) {
+				D[j] = A[j][j];
+				for (int k = 0; k < j; k++) {
+					D[j] -= A[j][k] * A[j][k] * D[k];
+				}
+				for (int i = j + 1; i < NUM_PARAMETERS; i++) {
+					Lane value = A[i][j];
+					for (int k = 0; k < j; k++) {
+						value -= A[i][k] * A[j][k] * D[k];
+					}
+					A[i][j] = value / D[j];
+				}
+			}
+
+			// L y = g, D z = y, Lt step = z
+			for (int i = 0; i < NUM_PARAMETERS; i++) {
+				this->step[i] = this->g[i];
+				for (int k = 0; k < i; k++) {
+					this->step[i] -= A[i][k] * this->step[k];
+				}
+			}
+			for (int i = 0; i < NUM_PARAMETERS; i++) {
+				this->step[i] /= D[i];
+			}
+			for (int i = NUM_PARAMETERS - 1; i >= 0; i--) {
+				for (int k = i + 1; k < NUM_PARAMETERS; k++) {
+					this->step[i] -= A[k][i] * this->step[k];
+				}
+			}
+		}
+
+		Lane cost;
+		Lane residuals[NUM_RESIDUALS];
+		Lane residualsNew[NUM_RESIDUALS];
+		Lane jacobian[NUM_RESIDUALS * NUM_PARAMETERS]; // column major
+		Lane jacobiScaling[NUM_PARAMETERS];
+		Lane jtj[NUM_PARAMETERS][NUM_PARAMETERS];
+		Lane regularized[NUM_PARAMETERS][NUM_PARAMETERS];
+		Lane g[NUM_PARAMETERS];
+		Lane step[NUM_PARAMETERS];
+		Lane dx[NUM_PARAMETERS];
+		Lane xNew[NUM_PARAMETERS];
+	};
+
+	//----------
+	// Runs a scalar TinySolver function lane by lane, so existing functions
+	// (including ceres::TinySolverAutoDiffFunction) work with LockstepTinySolver.
+	// The solver arithmetic stays SIMD, the function evaluation does not.
+	template<typename ScalarFunction, int Lanes = 4>
+	struct LockstepLaneAdapter {
+		enum {
+			NUM_RESIDUALS = ScalarFunction::NUM_RESIDUALS,
+			NUM_PARAMETERS = ScalarFunction::NUM_PARAMETERS
+		};
+
+		typedef Eigen::Array<double, Lanes, 1> Lane;
+
+		LockstepLaneAdapter(const ScalarFunction & function)
+			: function(function) {}
+
+		//----------
+		bool operator()(const Lane * parameters, Lane * residuals, Lane * jacobian) const {
+			double x[NUM_PARAMETERS];
+			double r[NUM_RESIDUALS];
+			double J[NUM_RESIDUALS * NUM_PARAMETERS];
+			bool succeeded = true;
+			for (int lane = 0; lane < Lanes; lane++) {
+				for (int i = 0; i < NUM_PARAMETERS; i++) {
+					x[i] = parameters[i][lane];
+				}
+				succeeded &= this->function(x, r, jacobian ? J : NULL);
+				for (int i = 0; i < NUM_RESIDUALS; i++) {
+					residuals[i][lane] = r[i];
+				}
+				if (jacobian) {
+					for (int i = 0; i < NUM_RESIDUALS * NUM_PARAMETERS; i++) {
+						jacobian[i][lane] = J[i];
+					}
+				}
+			}
+			return succeeded;
+		}
+
+		const ScalarFunction & function;
+	};
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ofxCeresSolver {
+	//----------
+	// Read only memory mapping of a whole file.
+	class MappedFile {
+	public:
+		MappedFile() {}
+
+		//----------
+		~MappedFile() {
+			this->close();
+		}
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
+
+		//----------
+		bool open(const std::string & path) {
+			this->close();
+
+#ifdef _WIN32
+			this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (this->file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0) {
+				this->close();
+				return false;
+			}
+			this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (!this->mapping) {
+				this->close();
+				return false;
+			}
+			this->data = (const uint8_t *) MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+			if (!this->data) {
+				this->close();
+				return false;
+			}
+			this->size = (size_t) fileSize.QuadPart;
+#else
+			this->file = ::open(path.c_str(), O_RDONLY);
+			if (this->file < 0) {
+				return false;
+			}
+			struct stat status;
+			if (fstat(this->file, &status) != 0 || status.st_size == 0) {
+				this->close();
+				return false;
+			}
+			void * mapped = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_SHARED, this->file, 0);
+			if (mapped == MAP_FAILED) {
+				this->close();
+				return false;
+			}
+			this->data = (const uint8_t *) mapped;
+			this->size = (size_t) status.st_size;
+#endif
+			return true;
+		}
+
+		//----------
+		void close() {
+#ifdef _WIN32
+			if (this->data) {
+				UnmapViewOfFile(this->data);
+			}
+			if (this->mapping) {
+				CloseHandle(this->mapping);
+			}
+			if (this->file != INVALID_HANDLE_VALUE) {
+				CloseHandle(this->file);
+			}
+			this->mapping = NULL;
+			this->file = INVALID_HANDLE_VALUE;
+#else
+			if (this->data) {
+				munmap((void *) this->data, this->size);
+			}
+			if (this->file >= 0) {
+				::close(this->file);
+			}
+			this->file = -1;
+#endif
+			this->data = nullptr;
+			this->size = 0;
+		}
+
+		//----------
+		// Tell the OS a range will be read front to back, e.g. when streaming a file
+		// larger than memory.
+		void adviseSequential(size_t offset, size_t length) const {
+#ifndef _WIN32
+			this->advise(offset, length, MADV_SEQUENTIAL);
+#endif
+		}
+
+		//----------
+		// Tell the OS a range is no longer needed so its pages can be dropped first.
+		void adviseDone(size_t offset, size_t length) const {
+#ifndef _WIN32
+			this->advise(offset, length, MADV_DONTNEED);
+#endif
+		}
+
+		//----------
+		bool isOpen() const {
+			return this->data != nullptr;
+		}
+
+		//----------
+		const uint8_t * getData() const {
+			return this->data;
+		}
+
+		//----------
+		size_t getSize() const {
+			return this->size;
+		}
+
+	protected:
+#ifndef _WIN32
+		//----------
+		void advise(size_t offset, size_t length, int advice) const {
+			if (!this->data || offset >= this->size) {
+				return;
+			}
+			// madvise wants a page aligned start
+			const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+			const size_t alignedOffset = offset - offset % pageSize;
+			length = std::min(length + (offset - alignedOffset), this->size - alignedOffset);
+			madvise((void *) (this->data + alignedOffset), length, advice);
+		}
+#endif
+
+		const uint8_t * data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#else
+		int file = -1;
+#endif
+	};
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverCostFunctions.h"
+#include "CeresSolverThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Global optimization by solving from many initial guesses concurrently and
+	// keeping the best solution, for problems with local minima (e.g. the Euler
+	// angle rigid fit from a poor guess). The runs share the lowest cost seen so
+	// far, and an IterationCallback aborts any run which is still more than
+	// pruneCostRatio times worse after pruneAfterIterations iterations.
+	class MultiStart {
+	public:
+		// adds the residual blocks to the problem, acting on the given parameters
+		typedef std::function<void(ceres::Problem & problem, double * parameters)> BuildProblem;
+
+		typedef std::vector<std::vector<double>> Starts;
+
+		struct Settings {
+			size_t startCount = 16;
+			int pruneAfterIterations = 3;
+			double pruneCostRatio = 2.0;
+			unsigned int seed = 0;
+
+			// also start from the parameters passed in (e.g. the last frame's solution)
+			bool includeInitialParameters = true;
+
+			ceres::Solver::Options solverOptions;
+		};
+
+		struct Run {
+			std::vector<double> initialParameters;
+			std::vector<double> parameters;
+			ceres::Solver::Summary summary;
+			bool pruned = false;
+		};
+
+		struct Result {
+			std::vector<Run> runs;
+			size_t bestRun = 0;
+			double bestCost = std::numeric_limits<double>::max();
+			size_t prunedCount = 0;
+
+			//----------
+			bool isSolutionUsable() const {
+				return this->bestRun < this->runs.size()
+					&& this->runs[this->bestRun].summary.IsSolutionUsable();
+			}
+		};
+
+		//----------
+		// Every start is solved on its own problem and its own copy of the
+		// parameters, and the best solution is written back to parameters.
+		static Result solve(const BuildProblem & buildProblem
+			, double * parameters
+			, int parameterCount
+			, const Starts & starts
+			, const Settings & settings
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			Result result;
+			if (settings.includeInitialParameters) {
+				result.runs.emplace_back();
+				result.runs.back().initialParameters.assign(parameters, parameters + parameterCount);
+			}
+			for (const auto & start : starts) {
+				result.runs.emplace_back();
+				result.runs.back().initialParameters = start;
+				result.runs.back().initialParameters.resize(parameterCount);
+			}
+
+			std::atomic<double> bestCost(std::numeric_limits<double>::max());
+			threadPool.parallelFor(result.runs.size(), [&](size_t i) {
+				auto & run = result.runs[i];
+				run.parameters = run.initialParameters;
+
+				ceres::Problem problem;
+				buildProblem(problem, run.parameters.data());
+
+				PruneCallback pruneCallback(bestCost, settings);
+				auto options = settings.solverOptions;
+				options.callbacks.push_back(&pruneCallback);
+				ceres::Solve(options, &problem, &run.summary);
+
+				run.pruned = pruneCallback.pruned;
+				if (run.summary.IsSolutionUsable()) {
+					updateMinimum(bestCost, run.summary.final_cost);
+				}
+			});
+
+			for (size_t i = 0; i < result.runs.size(); i++) {
+				const auto & run = result.runs[i];
+				if (run.pruned) {
+					result.prunedCount++;
+					continue;
+				}
+				if (run.summary.IsSolutionUsable() && run.summary.final_cost < result.bestCost) {
+					result.bestCost = run.summary.final_cost;
+					result.bestRun = i;
+				}
+			}
+
+			if (result.isSolutionUsable()) {
+				const auto & best = result.runs[result.bestRun].parameters;
+				std::copy(best.begin(), best.end(), parameters);
+			}
+			return result;
+		}
+
+		//----------
+		// Rigid body fit over point pairs with RigidBodyTransformError. The starts are
+		// random rotations, each with the translation which maps the centroid of the
+		// untransformed points onto the centroid of the transformed points.
+		static Result solve(const std::vector<glm::vec3> & untransformedPoints
+			, const std::vector<glm::vec3> & transformedPoints
+			, double * parameters
+			, const Settings & settings
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			const size_t count = std::min(untransformedPoints.size(), transformedPoints.size());
+			glm::tvec3<double> untransformedCentroid(0.0), transformedCentroid(0.0);
+			for (size_t i = 0; i < count; i++) {
+				untransformedCentroid += glm::tvec3<double>(untransformedPoints[i]);
+				transformedCentroid += glm::tvec3<double>(transformedPoints[i]);
+			}
+			if (count > 0) {
+				untransformedCentroid /= (double) count;
+				transformedCentroid /= (double) count;
+			}
+
+			Starts starts;
+			for (const auto & rotation : getRandomRotations(settings.startCount, settings.seed)) {
+				const glm::tvec3<double> rotationVector(rotation[0], rotation[1], rotation[2]);
+				const auto transform = VectorMath::createAffineTransform(glm::tvec3<double>(0.0), rotationVector);
+				const auto translation = transformedCentroid - transform.transformPoint(untransformedCentroid);
+				starts.push_back({ translation.x, translation.y, translation.z, rotation[0], rotation[1], rotation[2] });
+			}
+
+			return solve([&](ceres::Problem & problem, double * runParameters) {
+					for (size_t i = 0; i < count; i++) {
+						problem.AddResidualBlock(RigidBodyTransformError::Create(untransformedPoints[i], transformedPoints[i])
+							, NULL
+							, runParameters);
+					}
+				}
+				, parameters
+				, 6
+				, starts
+				, settings
+				, threadPool);
+		}
+
+		//----------
+		// Uniformly distributed rotations (Shoemake's method) as the Euler angles of
+		// VectorMath::eulerToQuat, i.e. parameters 3 to 5 of RigidBodyTransformError.
+		static Starts getRandomRotations(size_t count, unsigned int seed = 0) {
+			std::mt19937 random(seed);
+			std::uniform_real_distribution<double> uniform(0.0, 1.0);
+			Starts rotations;
+			for (size_t i = 0; i < count; i++) {
+				const double u1 = uniform(random);
+				const double u2 = 2.0 * M_PI * uniform(random);
+				const double u3 = 2.0 * M_PI * uniform(random);
+				const double a = std::sqrt(1.0 - u1);
+				const double b = std::sqrt(u1);
+				const double x = a * std::sin(u2);
+				const double y = a * std::cos(u2);
+				const double z = b * std::sin(u3);
+				const double w = b * std::cos(u3);
+
+				// inverse of eulerToQuat, as glm::eulerAngles
+				const double pitch = std::atan2(2.0 * (y * z + w * x), w * w - x * x - y * y + z * z);
+				const double yaw = std::asin(std::min(std::max(-2.0 * (x * z - w * y), -1.0), 1.0));
+				const double roll = std::atan2(2.0 * (x * y + w * z), w * w + x * x - y * y - z * z);
+				rotations.push_back({ pitch, yaw, roll });
+			}
+			return rotations;
+		}
+
+		//----------
+		// Halton low discrepancy points in the box [lower, upper], which cover the
+		// box more evenly than independent random points. skip drops the first points.
+		static Starts getHaltonPoints(size_t count
+			, const std::vector<double> & lower
+			, const std::vector<double> & upper
+			, size_t skip = 1) {
+			static const int primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+			const size_t dimension = std::min(lower.size(), upper.size());
+			Starts points;
+			for (size_t i = 0; i < count; i++) {
+				std::vector<double> point(dimension);
+				for (size_t d = 0; d < dimension; d++) {
+					const double unit = d < sizeof(primes) / sizeof(primes[0])
+						? radicalInverse(i + skip, primes[d])
+						: 0.5;
+					point[d] = lower[d] + unit * (upper[d] - lower[d]);
+				}
+				points.push_back(point);
+			}
+			return points;
+		}
+
+	protected:
+		//----------
+		class PruneCallback : public ceres::IterationCallback {
+		public:
+			PruneCallback(std::atomic<double> & bestCost, const Settings & settings)
+				: bestCost(bestCost)
+				, settings(settings) {}
+
+			//----------
+			ceres::CallbackReturnType operator()(const ceres::IterationSummary & summary) override {
+				updateMinimum(this->bestCost, summary.cost);
+				if (summary.iteration >= this->settings.pruneAfterIterations
+					&& summary.cost > this->bestCost.load() * this->settings.pruneCostRatio) {
+					this->pruned = true;
+					return ceres::SOLVER_ABORT;
+				}
+				return ceres::SOLVER_CONTINUE;
+			}
+
+			std::atomic<double> & bestCost;
+			const Settings & settings;
+			bool pruned = false;
+		};
+
+		//----------
+		static void updateMinimum(std::atomic<double> & minimum, double value) {
+			double current = minimum.load();
+			while (value < current && !minimum.compare_exchange_weak(current, value)) {
+			}
+		}
+
+		//----------
+		static double radicalInverse(size_t index, int base) {
+			double result = 0.0;
+			double fraction = 1.0 / base;
+			while (index > 0) {
+				result += (double) (index % base) * fraction;
+				index /= base;
+				fraction /= base;
+			}
+			return result;
+		}
+	};
+}
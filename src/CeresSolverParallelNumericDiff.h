@@ -0,0 +1,207 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverThreadPool.h"
+
+#include <Eigen/Dense>
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Numeric differentiation for expensive black box residuals (e.g. a light
+	// transport simulation) which evaluates the perturbed points of different
+	// parameters concurrently over the thread pool. Step sizes, FORWARD / CENTRAL /
+	// RIDDERS and the Ridders extrapolation follow ceres::NumericDiffCostFunction
+	// and its NumericDiffOptions.
+	//
+	// The functor is called from several threads at once, so its operator() must
+	// be safe to call concurrently:
+	//	bool operator()(double const * const * parameters, double * residuals) const;
+	template<typename Functor>
+	class ParallelNumericDiffCostFunction : public ceres::CostFunction {
+	public:
+		//----------
+		ParallelNumericDiffCostFunction(Functor * functor
+			, const std::vector<int> & parameterBlockSizes
+			, int numResiduals
+			, ceres::NumericDiffMethodType method = ceres::CENTRAL
+			, const ceres::NumericDiffOptions & options = ceres::NumericDiffOptions()
+			, ThreadPool & threadPool = ThreadPool::getShared())
+			: functor(functor)
+			, method(method)
+			, options(options)
+			, threadPool(threadPool) {
+			*this->mutable_parameter_block_sizes() = parameterBlockSizes;
+			this->set_num_residuals(numResiduals);
+		}
+
+		//----------
+		bool Evaluate(double const * const * parameters
+			, double * residuals
+			, double ** jacobians) const override {
+			if (!(*this->functor)(parameters, residuals)) {
+				return false;
+			}
+			if (!jacobians) {
+				return true;
+			}
+
+			const auto & blockSizes = this->parameter_block_sizes();
+			int parameterCount = 0;
+			std::vector<Column> columns;
+			for (int block = 0; block < (int) blockSizes.size(); block++) {
+				parameterCount += blockSizes[block];
+				if (!jacobians[block]) {
+					continue;
+				}
+				for (int i = 0; i < blockSizes[block]; i++) {
+					columns.push_back({ block, i, parameterCount - blockSizes[block] + i });
+				}
+			}
+
+			std::atomic<bool> failed(false);
+			this->threadPool.parallelForChunked(columns.size(), [&](size_t begin, size_t end) {
+				// each chunk perturbs its own copy of the parameters
+				Scratch scratch(parameterCount, (int) blockSizes.size(), this->num_residuals(), this->options.max_num_ridders_extrapolations);
+				int offset = 0;
+				for (int block = 0; block < (int) blockSizes.size(); block++) {
+					std::copy(parameters[block], parameters[block] + blockSizes[block], scratch.values.data() + offset);
+					scratch.parameters[block] = scratch.values.data() + offset;
+					offset += blockSizes[block];
+				}
+
+				for (size_t i = begin; i < end && !failed; i++) {
+					const auto & column = columns[i];
+					double * x = scratch.values.data() + column.offset;
+					if (!this->evaluateColumn(scratch, x, residuals)) {
+						failed = true;
+						return;
+					}
+					const int blockSize = blockSizes[column.block];
+					for (int residual = 0; residual < this->num_residuals(); residual++) {
+						jacobians[column.block][residual * blockSize + column.index] = scratch.column(residual);
+					}
+				}
+			});
+
+			return !failed;
+		}
+
+	protected:
+		struct Column {
+			int block;
+			int index; // within the block
+			int offset; // within all parameters
+		};
+
+		struct Scratch {
+			Scratch(int parameterCount, int blockCount, int residualCount, int extrapolations)
+				: values(parameterCount)
+				, parameters(blockCount)
+				, column(residualCount)
+				, forward(residualCount)
+				, backward(residualCount)
+				, currentCandidates(residualCount, std::max(1, extrapolations))
+				, previousCandidates(residualCount, std::max(1, extrapolations)) {}
+
+			std::vector<double> values;
+			std::vector<const double *> parameters;
+			Eigen::VectorXd column;
+			Eigen::VectorXd forward;
+			Eigen::VectorXd backward;
+			Eigen::MatrixXd currentCandidates;
+			Eigen::MatrixXd previousCandidates;
+		};
+
+		//----------
+		bool evaluateColumn(Scratch & scratch, double * x, const double * residualsAtX) const {
+			double minimumStep = std::sqrt(std::numeric_limits<double>::epsilon());
+			double relativeStep = this->options.relative_step_size;
+			if (this->method == ceres::RIDDERS) {
+				minimumStep = std::max(minimumStep, this->options.ridders_relative_initial_step_size);
+				relativeStep = this->options.ridders_relative_initial_step_size;
+			}
+			const double step = std::max(minimumStep, std::abs(*x) * relativeStep);
+
+			if (this->method == ceres::RIDDERS) {
+				return this->evaluateRiddersColumn(scratch, x, step, residualsAtX);
+			}
+			return this->evaluateDifference(scratch, x, step, residualsAtX, scratch.column);
+		}
+
+		//----------
+		bool evaluateDifference(Scratch & scratch, double * x, double step, const double * residualsAtX, Eigen::Ref<Eigen::VectorXd> column) const {
+			const double value = *x;
+			*x = value + step;
+			bool succeeded = (*this->functor)(scratch.parameters.data(), scratch.forward.data());
+			if (succeeded && this->method != ceres::FORWARD) {
+				*x = value - step;
+				succeeded = (*this->functor)(scratch.parameters.data(), scratch.backward.data());
+				column = (scratch.forward - scratch.backward) / (2.0 * step);
+			}
+			else if (succeeded) {
+				column = (scratch.forward - Eigen::Map<const Eigen::VectorXd>(residualsAtX, scratch.forward.size())) / step;
+			}
+			*x = value;
+			return succeeded;
+		}
+
+		//----------
+		// Romberg tableau over shrinking steps, as ceres' Ridders implementation
+		bool evaluateRiddersColumn(Scratch & scratch, double * x, double step, const double * residualsAtX) const {
+			const auto & options = this->options;
+			double currentStep = step * std::pow(options.ridders_step_shrink_factor, options.max_num_ridders_extrapolations / 2);
+			auto * current = &scratch.currentCandidates;
+			auto * previous = &scratch.previousCandidates;
+			double normError = std::numeric_limits<double>::max();
+
+			for (int i = 0; i < options.max_num_ridders_extrapolations; i++) {
+				if (!this->evaluateDifference(scratch, x, currentStep, residualsAtX, current->col(0))) {
+					return false;
+				}
+				if (i == 0) {
+					scratch.column = current->col(0);
+				}
+				currentStep /= options.ridders_step_shrink_factor;
+
+				double richardsonFactor = options.ridders_step_shrink_factor * options.ridders_step_shrink_factor;
+				for (int k = 1; k <= i; k++) {
+					current->col(k) = (richardsonFactor * current->col(k - 1) - previous->col(k - 1)) / (richardsonFactor - 1.0);
+					richardsonFactor *= options.ridders_step_shrink_factor * options.ridders_step_shrink_factor;
+
+					const double candidateError = std::max((current->col(k) - current->col(k - 1)).norm()
+						, (current->col(k) - previous->col(k - 1)).norm());
+					if (candidateError <= normError) {
+						normError = candidateError;
+						scratch.column = current->col(k);
+						if (normError < options.ridders_epsilon) {
+							break;
+						}
+					}
+				}
+
+				if (normError < options.ridders_epsilon) {
+					break;
+				}
+
+				// numerically unstable, keep the last stable result
+				if (i > 0 && (current->col(i) - previous->col(i - 1)).norm() >= 2.0 * normError) {
+					break;
+				}
+
+				std::swap(current, previous);
+			}
+			return true;
+		}
+
+		std::unique_ptr<Functor> functor;
+		ceres::NumericDiffMethodType method;
+		ceres::NumericDiffOptions options;
+		ThreadPool & threadPool;
+	};
+}
@@ -0,0 +1,469 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverMappedFile.h"
+#include "CeresSolverSnapshot.h"
+#include "CeresSolverThreadPool.h"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Strided view of point pairs stored as 3 consecutive floats, e.g. straight
+	// inside a memory mapped file. Nothing is copied.
+	struct PointPairChunk {
+		const uint8_t * untransformed = nullptr;
+		const uint8_t * transformed = nullptr;
+		size_t untransformedStride = 0; // bytes
+		size_t transformedStride = 0; // bytes
+		size_t count = 0;
+
+		//----------
+		glm::tvec3<double> getUntransformed(size_t index) const {
+			return read(this->untransformed + index * this->untransformedStride);
+		}
+
+		//----------
+		glm::tvec3<double> getTransformed(size_t index) const {
+			return read(this->transformed + index * this->transformedStride);
+		}
+
+		//----------
+		static glm::tvec3<double> read(const uint8_t * data) {
+			// records in PLY files are not necessarily 4 byte aligned
+			float values[3];
+			std::memcpy(values, data, sizeof(values));
+			return glm::tvec3<double>(values[0], values[1], values[2]);
+		}
+	};
+
+	//----------
+	// RigidBodyTransformError over a whole chunk in one residual block.
+	// The transform is built once per evaluation instead of once per point.
+	struct RigidBodyTransformBatchError {
+		RigidBodyTransformBatchError(const PointPairChunk & chunk)
+			: chunk(chunk) {}
+
+		template <typename T>
+		bool operator()(const T * const transformParameters
+			, T * residuals) const {
+
+			glm::tvec3<T> translation(transformParameters[0], transformParameters[1], transformParameters[2]);
+			glm::tvec3<T> rotationVector(transformParameters[3], transformParameters[4], transformParameters[5]);
+
+			auto transform = VectorMath::createAffineTransform(translation, rotationVector);
+
+			for (size_t i = 0; i < this->chunk.count; i++) {
+				const auto untransformedPoint = this->chunk.getUntransformed(i);
+				const auto transformedPoint = this->chunk.getTransformed(i);
+				auto predictedTransformedPoint = transform.transformPoint(untransformedPoint);
+				for (int j = 0; j < 3; j++) {
+					residuals[i * 3 + j] = transformedPoint[j] - predictedTransformedPoint[j];
+				}
+			}
+
+			return true;
+		}
+
+		static ceres::CostFunction * Create(const PointPairChunk & chunk) {
+			return (new ceres::AutoDiffCostFunction<RigidBodyTransformBatchError, ceres::DYNAMIC, 6>(
+				new RigidBodyTransformBatchError(chunk), (int) chunk.count * 3));
+		}
+
+		PointPairChunk chunk;
+	};
+
+	//----------
+	// Memory mapped point pairs from
+	//	- snapshot files (Snapshot::save)
+	//	- raw files of float[6] records (untransformed xyz, transformed xyz)
+	//	- binary little endian PLY, either one file holding both points per vertex
+	//	  or two files with matching vertex order
+	class PointPairFile {
+	public:
+		//----------
+		bool openBinary(const std::string & path) {
+			this->close();
+			this->files.emplace_back(new MappedFile());
+			auto & file = *this->files.back();
+			if (!file.open(path)) {
+				this->close();
+				return false;
+			}
+
+			size_t offset = 0;
+			size_t count = file.getSize() / sizeof(Snapshot::Correspondence);
+			if (file.getSize() >= sizeof(Snapshot::Header)
+				&& std::memcmp(file.getData(), Snapshot::Magic, sizeof(Snapshot::Magic)) == 0) {
+				auto header = (const Snapshot::Header *) file.getData();
+				offset = (size_t) header->correspondenceOffset;
+				count = (size_t) header->correspondenceCount;
+				if (offset > file.getSize()
+					|| count > (file.getSize() - offset) / sizeof(Snapshot::Correspondence)) {
+					this->close();
+					return false;
+				}
+			}
+
+			this->untransformed = file.getData() + offset;
+			this->transformed = this->untransformed + 3 * sizeof(float);
+			this->untransformedStride = sizeof(Snapshot::Correspondence);
+			this->transformedStride = sizeof(Snapshot::Correspondence);
+			this->count = count;
+			this->ranges.push_back({ &file, offset, sizeof(Snapshot::Correspondence) });
+			return true;
+		}
+
+		//----------
+		// One PLY whose vertices hold both points. x y z is the untransformed point.
+		bool openPLY(const std::string & path
+			, const std::string & transformedX = "tx"
+			, const std::string & transformedY = "ty"
+			, const std::string & transformedZ = "tz") {
+			this->close();
+			PLYVertices vertices;
+			if (!this->openPLYVertices(path, vertices)) {
+				this->close();
+				return false;
+			}
+			size_t untransformedOffset, transformedOffset;
+			if (!vertices.findPoint("x", "y", "z", untransformedOffset)
+				|| !vertices.findPoint(transformedX, transformedY, transformedZ, transformedOffset)) {
+				this->close();
+				return false;
+			}
+
+			this->untransformed = vertices.data + untransformedOffset;
+			this->transformed = vertices.data + transformedOffset;
+			this->untransformedStride = vertices.stride;
+			this->transformedStride = vertices.stride;
+			this->count = vertices.count;
+			return true;
+		}
+
+		//----------
+		// Two PLYs with the same vertex count and order, x y z in each
+		bool openPLYPair(const std::string & untransformedPath, const std::string & transformedPath) {
+			this->close();
+			PLYVertices untransformedVertices, transformedVertices;
+			size_t untransformedOffset, transformedOffset;
+			if (!this->openPLYVertices(untransformedPath, untransformedVertices)
+				|| !this->openPLYVertices(transformedPath, transformedVertices)
+				|| untransformedVertices.count != transformedVertices.count
+				|| !untransformedVertices.findPoint("x", "y", "z", untransformedOffset)
+				|| !transformedVertices.findPoint("x", "y", "z", transformedOffset)) {
+				this->close();
+				return false;
+			}
+
+			this->untransformed = untransformedVertices.data + untransformedOffset;
+			this->transformed = transformedVertices.data + transformedOffset;
+			this->untransformedStride = untransformedVertices.stride;
+			this->transformedStride = transformedVertices.stride;
+			this->count = untransformedVertices.count;
+			return true;
+		}
+
+		//----------
+		void close() {
+			this->files.clear();
+			this->ranges.clear();
+			this->untransformed = nullptr;
+			this->transformed = nullptr;
+			this->count = 0;
+		}
+
+		//----------
+		size_t size() const {
+			return this->count;
+		}
+
+		//----------
+		PointPairChunk getChunk(size_t begin, size_t count) const {
+			PointPairChunk chunk;
+			if (begin >= this->count) {
+				return chunk;
+			}
+			chunk.untransformed = this->untransformed + begin * this->untransformedStride;
+			chunk.transformed = this->transformed + begin * this->transformedStride;
+			chunk.untransformedStride = this->untransformedStride;
+			chunk.transformedStride = this->transformedStride;
+			chunk.count = std::min(count, this->count - begin);
+			return chunk;
+		}
+
+		//----------
+		// Hints for walking the file in order and dropping what has been read,
+		// which keeps the resident set bounded on files larger than RAM.
+		void adviseSequential(size_t begin, size_t count) const {
+			for (const auto & range : this->ranges) {
+				range.file->adviseSequential(range.offset + begin * range.stride, count * range.stride);
+			}
+		}
+
+		//----------
+		void adviseDone(size_t begin, size_t count) const {
+			for (const auto & range : this->ranges) {
+				range.file->adviseDone(range.offset + begin * range.stride, count * range.stride);
+			}
+		}
+
+	protected:
+		struct PLYProperty {
+			std::string name;
+			std::string type;
+			size_t offset;
+		};
+
+		struct PLYVertices {
+			const uint8_t * data = nullptr;
+			size_t count = 0;
+			size_t stride = 0;
+			std::vector<PLYProperty> properties;
+
+			//----------
+			// 3 consecutive float properties
+			bool findPoint(const std::string & x, const std::string & y, const std::string & z, size_t & offset) const {
+				for (size_t i = 0; i + 2 < this->properties.size(); i++) {
+					const auto & px = this->properties[i];
+					const auto & py = this->properties[i + 1];
+					const auto & pz = this->properties[i + 2];
+					if (px.name == x && py.name == y && pz.name == z
+						&& isFloat(px.type) && isFloat(py.type) && isFloat(pz.type)) {
+						offset = px.offset;
+						return true;
+					}
+				}
+				return false;
+			}
+
+			//----------
+			static bool isFloat(const std::string & type) {
+				return type == "float" || type == "float32";
+			}
+		};
+
+		struct Range {
+			const MappedFile * file;
+			size_t offset;
+			size_t stride;
+		};
+
+		//----------
+		static size_t getPLYTypeSize(const std::string & type) {
+			if (type == "char" || type == "uchar" || type == "int8" || type == "uint8") {
+				return 1;
+			}
+			if (type == "short" || type == "ushort" || type == "int16" || type == "uint16") {
+				return 2;
+			}
+			if (type == "int" || type == "uint" || type == "float" || type == "int32" || type == "uint32" || type == "float32") {
+				return 4;
+			}
+			if (type == "double" || type == "float64") {
+				return 8;
+			}
+			return 0;
+		}
+
+		//----------
+		// Only the header is parsed. The vertex element must come first and have no list properties.
+		bool openPLYVertices(const std::string & path, PLYVertices & vertices) {
+			this->files.emplace_back(new MappedFile());
+			auto & file = *this->files.back();
+			if (!file.open(path)) {
+				return false;
+			}
+
+			const char * text = (const char *) file.getData();
+			// header lines may end in \n or \r\n, the \r is whitespace to the parsing below
+			const char endHeader[] = "end_header";
+			const size_t endHeaderLength = sizeof(endHeader) - 1;
+			const char * end = nullptr;
+			const size_t searchLength = std::min(file.getSize(), (size_t) 64 * 1024);
+			for (size_t i = 0; i + endHeaderLength < searchLength; i++) {
+				if (std::memcmp(text + i, endHeader, endHeaderLength) != 0) {
+					continue;
+				}
+				size_t lineEnd = i + endHeaderLength;
+				if (text[lineEnd] == '\r' && lineEnd + 1 < searchLength) {
+					lineEnd++;
+				}
+				if (text[lineEnd] == '\n') {
+					end = text + lineEnd + 1;
+					break;
+				}
+			}
+			if (!end) {
+				return false;
+			}
+
+			std::istringstream header(std::string(text, end));
+			std::string line;
+			bool binaryLittleEndian = false;
+			bool inVertex = false;
+			bool vertexSeen = false;
+			while (std::getline(header, line)) {
+				std::istringstream words(line);
+				std::string keyword;
+				words >> keyword;
+				if (keyword == "format") {
+					std::string format;
+					words >> format;
+					binaryLittleEndian = format == "binary_little_endian";
+				}
+				else if (keyword == "element") {
+					std::string name;
+					words >> name;
+					if (name == "vertex" && !vertexSeen) {
+						words >> vertices.count;
+						inVertex = true;
+						vertexSeen = true;
+					}
+					else if (!vertexSeen) {
+						// an element before the vertices would need parsing to skip
+						return false;
+					}
+					else {
+						inVertex = false;
+					}
+				}
+				else if (keyword == "property" && inVertex) {
+					PLYProperty property;
+					words >> property.type >> property.name;
+					const auto size = getPLYTypeSize(property.type);
+					if (size == 0) {
+						// includes list properties
+						return false;
+					}
+					property.offset = vertices.stride;
+					vertices.stride += size;
+					vertices.properties.push_back(property);
+				}
+			}
+
+			if (!binaryLittleEndian || !vertexSeen || vertices.stride == 0) {
+				return false;
+			}
+
+			const size_t dataOffset = end - text;
+			if (dataOffset > file.getSize()
+				|| vertices.count > (file.getSize() - dataOffset) / vertices.stride) {
+				return false;
+			}
+			vertices.data = file.getData() + dataOffset;
+			this->ranges.push_back({ &file, dataOffset, vertices.stride });
+			return true;
+		}
+
+		std::vector<std::unique_ptr<MappedFile>> files;
+		std::vector<Range> ranges;
+
+		const uint8_t * untransformed = nullptr;
+		const uint8_t * transformed = nullptr;
+		size_t untransformedStride = 0;
+		size_t transformedStride = 0;
+		size_t count = 0;
+	};
+
+	//----------
+	// Rigid body solve over a PointPairFile which may be larger than RAM.
+	// The data is split in chunks of RigidBodyTransformBatchError. Each mini batch
+	// is a run of consecutive chunks solved for a few iterations, warm starting
+	// from the previous batch, so only one batch needs to be resident at a time.
+	// With chunkStride > 1 only every n-th chunk is visited (subsampling).
+	class StreamingRigidBodySolver {
+	public:
+		struct Settings {
+			size_t chunkSize = 4096; // point pairs per residual block
+			size_t chunksPerBatch = 64;
+			size_t chunkStride = 1;
+			int epochs = 1;
+			int iterationsPerBatch = 5;
+
+			// stream the whole file once more at the end to measure the final cost
+			bool evaluateFullCost = true;
+		};
+
+		struct Result {
+			size_t batches = 0;
+			size_t pointPairsUsed = 0;
+			double finalCost = 0.0; // 0.5 * sum of squared residuals over the whole file, if evaluated
+			double rmsError = 0.0;
+		};
+
+		//----------
+		void setSettings(const Settings & settings) {
+			this->settings = settings;
+		}
+
+		//----------
+		// parameters is the initial guess on input
+		Result solve(const PointPairFile & file, double * parameters, ThreadPool & threadPool = ThreadPool::getShared()) {
+			Result result;
+			const size_t chunkSize = std::max((size_t) 1, this->settings.chunkSize);
+			const size_t chunkCount = (file.size() + chunkSize - 1) / chunkSize;
+			const size_t chunkStride = std::max((size_t) 1, this->settings.chunkStride);
+
+			ceres::Solver::Options options;
+			options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = this->settings.iterationsPerBatch;
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+
+			for (int epoch = 0; epoch < this->settings.epochs; epoch++) {
+				size_t chunk = 0;
+				while (chunk < chunkCount) {
+					ceres::Problem problem;
+					size_t batchBegin = chunk * chunkSize;
+					size_t batchEnd = batchBegin;
+					for (size_t i = 0; i < this->settings.chunksPerBatch && chunk < chunkCount; i++, chunk += chunkStride) {
+						const auto pointPairs = file.getChunk(chunk * chunkSize, chunkSize);
+						problem.AddResidualBlock(RigidBodyTransformBatchError::Create(pointPairs), NULL, parameters);
+						batchEnd = chunk * chunkSize + pointPairs.count;
+						if (epoch == 0) {
+							result.pointPairsUsed += pointPairs.count;
+						}
+					}
+
+					file.adviseSequential(batchBegin, batchEnd - batchBegin);
+					ceres::Solver::Summary summary;
+					ceres::Solve(options, &problem, &summary);
+					file.adviseDone(batchBegin, batchEnd - batchBegin);
+					result.batches++;
+				}
+			}
+
+			if (this->settings.evaluateFullCost && file.size() > 0) {
+				std::mutex mutex;
+				threadPool.parallelForChunked(chunkCount, [&](size_t begin, size_t end) {
+					double cost = 0.0;
+					std::vector<double> residuals;
+					for (size_t i = begin; i < end; i++) {
+						const auto pointPairs = file.getChunk(i * chunkSize, chunkSize);
+						residuals.resize(pointPairs.count * 3);
+						const RigidBodyTransformBatchError error(pointPairs);
+						error(parameters, residuals.data());
+						for (auto residual : residuals) {
+							cost += residual * residual;
+						}
+						file.adviseDone(i * chunkSize, pointPairs.count);
+					}
+					std::lock_guard<std::mutex> lock(mutex);
+					result.finalCost += 0.5 * cost;
+				});
+				result.rmsError = sqrt(2.0 * result.finalCost / (double) file.size());
+			}
+
+			return result;
+		}
+
+	protected:
+		Settings settings;
+	};
+}
@@ -0,0 +1,632 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Error of the relative transform between two poses against its measurement
+	// (e.g. the offset between two rooms' tracking systems, or odometry), as
+	// ceres' pose_graph_3d example: translation in the frame of pose a, then twice
+	// the vector part of the quaternion difference (about the rotation angle),
+	// weighted by the square root of the measurement's information matrix.
+	// Poses are a position (3) and an Eigen order (x, y, z, w) unit quaternion (4).
+	struct RelativePoseError {
+		RelativePoseError(const Eigen::Vector3d & relativePosition
+			, const Eigen::Quaterniond & relativeOrientation
+			, const Eigen::Matrix<double, 6, 6> & sqrtInformation)
+			: relativePosition(relativePosition)
+			, relativeOrientation(relativeOrientation)
+			, sqrtInformation(sqrtInformation) {}
+
+		template <typename T>
+		bool operator()(const T * const positionA
+			, const T * const orientationA
+			, const T * const positionB
+			, const T * const orientationB
+			, T * residuals) const {
+			Eigen::Map<const Eigen::Matrix<T, 3, 1>> pA(positionA);
+			Eigen::Map<const Eigen::Quaternion<T>> qA(orientationA);
+			Eigen::Map<const Eigen::Matrix<T, 3, 1>> pB(positionB);
+			Eigen::Map<const Eigen::Quaternion<T>> qB(orientationB);
+
+			const Eigen::Quaternion<T> qAInverse = qA.conjugate();
+			const Eigen::Quaternion<T> qAB = qAInverse * qB;
+			const Eigen::Matrix<T, 3, 1> pAB = qAInverse * (pB - pA);
+			const Eigen::Quaternion<T> deltaQ = this->relativeOrientation.template cast<T>() * qAB.conjugate();
+
+			Eigen::Map<Eigen::Matrix<T, 6, 1>> residual(residuals);
+			residual.template head<3>() = pAB - this->relativePosition.template cast<T>();
+			residual.template tail<3>() = T(2.0) * deltaQ.vec();
+			residual.applyOnTheLeft(this->sqrtInformation.template cast<T>());
+			return true;
+		}
+
+		static ceres::CostFunction * Create(const Eigen::Vector3d & relativePosition
+			, const Eigen::Quaterniond & relativeOrientation
+			, const Eigen::Matrix<double, 6, 6> & sqrtInformation) {
+			return (new ceres::AutoDiffCostFunction<RelativePoseError, 6, 3, 4, 3, 4>(
+				new RelativePoseError(relativePosition, relativeOrientation, sqrtInformation)));
+		}
+
+		// unaligned, so functors can live anywhere the allocator puts them
+		Eigen::Matrix<double, 3, 1, Eigen::DontAlign> relativePosition;
+		Eigen::Quaternion<double, Eigen::DontAlign> relativeOrientation;
+		Eigen::Matrix<double, 6, 6, Eigen::DontAlign> sqrtInformation;
+	};
+
+	//----------
+	// SE(3) pose graph: poses connected by relative pose measurements, solved for
+	// the poses which agree best with all measurements. Reads and writes the g2o
+	// text format (VERTEX_SE3:QUAT, EDGE_SE3:QUAT), streaming line by line.
+	class PoseGraph {
+	public:
+		struct Pose {
+			int id;
+			double position[3];
+			double orientation[4]; // x, y, z, w
+
+			//----------
+			Eigen::Vector3d getPosition() const {
+				return Eigen::Vector3d(this->position[0], this->position[1], this->position[2]);
+			}
+
+			//----------
+			Eigen::Quaterniond getOrientation() const {
+				return Eigen::Quaterniond(this->orientation[3], this->orientation[0], this->orientation[1], this->orientation[2]);
+			}
+
+			//----------
+			void set(const Eigen::Vector3d & position, const Eigen::Quaterniond & orientation) {
+				for (int i = 0; i < 3; i++) {
+					this->position[i] = position[i];
+				}
+				const auto normalized = orientation.normalized();
+				this->orientation[0] = normalized.x();
+				this->orientation[1] = normalized.y();
+				this->orientation[2] = normalized.z();
+				this->orientation[3] = normalized.w();
+			}
+		};
+
+		struct Constraint {
+			int idA;
+			int idB;
+			Eigen::Matrix<double, 3, 1, Eigen::DontAlign> relativePosition;
+			Eigen::Quaternion<double, Eigen::DontAlign> relativeOrientation;
+			Eigen::Matrix<double, 6, 6, Eigen::DontAlign> information;
+		};
+
+		struct Settings {
+			ceres::Solver::Options solverOptions = defaultSolverOptions();
+
+			// robust loss scale in units of the measurement noise, 0 for none
+			double huberScale = 0.0;
+		};
+
+		//----------
+		// Every residual block touches 2 poses, so the normal equations are very
+		// sparse: SPARSE_NORMAL_CHOLESKY with the sparse library ceres was built
+		// with (Eigen's for the bundled build), which also orders for fill in.
+		static ceres::Solver::Options defaultSolverOptions() {
+			ceres::Solver::Options options;
+			options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = 100;
+			options.function_tolerance = 1e-8;
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+			return options;
+		}
+
+		//----------
+		void clear() {
+			this->poses.clear();
+			this->poseIndices.clear();
+			this->constraints.clear();
+		}
+
+		//----------
+		// Adding or replacing a pose keeps the address of existing poses only
+		// while no new pose is added, so finish the graph before solve.
+		void addPose(int id, const Eigen::Vector3d & position, const Eigen::Quaterniond & orientation) {
+			auto findPose = this->poseIndices.find(id);
+			if (findPose == this->poseIndices.end()) {
+				this->poseIndices[id] = this->poses.size();
+				this->poses.emplace_back();
+				this->poses.back().id = id;
+				this->poses.back().set(position, orientation);
+			}
+			else {
+				this->poses[findPose->second].set(position, orientation);
+			}
+		}
+
+		//----------
+		void addConstraint(int idA, int idB
+			, const Eigen::Vector3d & relativePosition
+			, const Eigen::Quaterniond & relativeOrientation
+			, const Eigen::Matrix<double, 6, 6> & information) {
+			Constraint constraint;
+			constraint.idA = idA;
+			constraint.idB = idB;
+			constraint.relativePosition = relativePosition;
+			constraint.relativeOrientation = relativeOrientation.normalized();
+			constraint.information = information;
+			this->constraints.push_back(constraint);
+		}
+
+		//----------
+		bool loadG2O(const std::string & path) {
+			std::ifstream file(path);
+			if (!file.is_open()) {
+				return false;
+			}
+			return this->loadG2O(file);
+		}
+
+		//----------
+		// Unknown record types (e.g. FIX or 2D records) are skipped
+		bool loadG2O(std::istream & stream) {
+			this->clear();
+			std::string line;
+			double values[30];
+			while (std::getline(stream, line)) {
+				const char * text = line.c_str();
+				if (startsWith(text, "VERTEX_SE3:QUAT")) {
+					if (parseValues(text + strlen("VERTEX_SE3:QUAT"), values, 8) != 8) {
+						return false;
+					}
+					this->addPose((int) values[0]
+						, Eigen::Vector3d(values[1], values[2], values[3])
+						, Eigen::Quaterniond(values[7], values[4], values[5], values[6]));
+				}
+				else if (startsWith(text, "EDGE_SE3:QUAT")) {
+					if (parseValues(text + strlen("EDGE_SE3:QUAT"), values, 30) != 30) {
+						return false;
+					}
+					// upper triangle of the information matrix, row by row
+					Eigen::Matrix<double, 6, 6> information;
+					for (int row = 0, index = 9; row < 6; row++) {
+						for (int column = row; column < 6; column++, index++) {
+							information(row, column) = values[index];
+							information(column, row) = values[index];
+						}
+					}
+					this->addConstraint((int) values[0], (int) values[1]
+						, Eigen::Vector3d(values[2], values[3], values[4])
+						, Eigen::Quaterniond(values[8], values[5], values[6], values[7])
+						, information);
+				}
+			}
+			return true;
+		}
+
+		//----------
+		bool saveG2O(const std::string & path) const {
+			std::ofstream file(path);
+			if (!file.is_open()) {
+				return false;
+			}
+			file << std::setprecision(17);
+			for (const auto & pose : this->poses) {
+				file << "VERTEX_SE3:QUAT " << pose.id;
+				for (int i = 0; i < 3; i++) {
+					file << " " << pose.position[i];
+				}
+				for (int i = 0; i < 4; i++) {
+					file << " " << pose.orientation[i];
+				}
+				file << "\n";
+			}
+			for (const auto & constraint : this->constraints) {
+				file << "EDGE_SE3:QUAT " << constraint.idA << " " << constraint.idB;
+				for (int i = 0; i < 3; i++) {
+					file << " " << constraint.relativePosition[i];
+				}
+				file << " " << constraint.relativeOrientation.x()
+					<< " " << constraint.relativeOrientation.y()
+					<< " " << constraint.relativeOrientation.z()
+					<< " " << constraint.relativeOrientation.w();
+				for (int row = 0; row < 6; row++) {
+					for (int column = row; column < 6; column++) {
+						file << " " << constraint.information(row, column);
+					}
+				}
+				file << "\n";
+			}
+			return true;
+		}
+
+		//----------
+		// Initial guess by composing measurements outwards from the first constrained
+		// pose along a breadth first spanning tree, for graphs given without (or with
+		// poor) poses.
+		void initializeFromSpanningTree() {
+			const size_t root = this->getFirstConstrainedPoseIndex();
+			if (root == this->poses.size()) {
+				return;
+			}
+			std::vector<std::vector<std::pair<size_t, bool>>> neighbours(this->poses.size()); // constraint, forward
+			for (size_t i = 0; i < this->constraints.size(); i++) {
+				const auto & constraint = this->constraints[i];
+				if (!this->hasPose(constraint.idA) || !this->hasPose(constraint.idB)) {
+					continue;
+				}
+				neighbours[this->poseIndices[constraint.idA]].emplace_back(i, true);
+				neighbours[this->poseIndices[constraint.idB]].emplace_back(i, false);
+			}
+
+			std::vector<bool> visited(this->poses.size(), false);
+			std::queue<size_t> queue;
+			queue.push(root);
+			visited[root] = true;
+			while (!queue.empty()) {
+				const size_t index = queue.front();
+				queue.pop();
+				const auto & pose = this->poses[index];
+				for (const auto & neighbour : neighbours[index]) {
+					const auto & constraint = this->constraints[neighbour.first];
+					const size_t other = this->poseIndices[neighbour.second ? constraint.idB : constraint.idA];
+					if (visited[other]) {
+						continue;
+					}
+					visited[other] = true;
+					const Eigen::Vector3d relativePosition = constraint.relativePosition;
+					const Eigen::Quaterniond relativeOrientation = constraint.relativeOrientation;
+					if (neighbour.second) {
+						// other = pose * relative
+						this->poses[other].set(pose.getPosition() + pose.getOrientation() * relativePosition
+							, pose.getOrientation() * relativeOrientation);
+					}
+					else {
+						// other = pose * relative^-1
+						const Eigen::Quaterniond orientation = pose.getOrientation() * relativeOrientation.conjugate();
+						this->poses[other].set(pose.getPosition() - orientation * relativePosition, orientation);
+					}
+					queue.push(other);
+				}
+			}
+		}
+
+		//----------
+		ceres::Solver::Summary solve() {
+			return this->solve(Settings());
+		}
+
+		//----------
+		// The first constrained pose is held fixed to remove the gauge freedom.
+		ceres::Solver::Summary solve(const Settings & settings) {
+			ceres::Problem problem;
+			this->build(problem, settings);
+			ceres::Solver::Summary summary;
+			ceres::Solve(settings.solverOptions, &problem, &summary);
+			for (auto & pose : this->poses) {
+				// the parameterization keeps unit length up to rounding
+				pose.set(pose.getPosition(), pose.getOrientation());
+			}
+			return summary;
+		}
+
+		//----------
+		void build(ceres::Problem & problem, const Settings & settings) {
+			// the problem only takes ownership once they are used
+			std::unique_ptr<ceres::LossFunction> lossFunction(settings.huberScale > 0.0
+				? new ceres::HuberLoss(settings.huberScale)
+				: NULL);
+			std::unique_ptr<ceres::LocalParameterization> quaternionParameterization(new ceres::EigenQuaternionParameterization());
+			bool constraintAdded = false;
+
+			for (const auto & constraint : this->constraints) {
+				if (!this->hasPose(constraint.idA) || !this->hasPose(constraint.idB)) {
+					continue;
+				}
+				auto & poseA = this->poses[this->poseIndices[constraint.idA]];
+				auto & poseB = this->poses[this->poseIndices[constraint.idB]];
+
+				const Eigen::Matrix<double, 6, 6> information = constraint.information;
+				const Eigen::Matrix<double, 6, 6> sqrtInformation = information.llt().matrixL().transpose();
+				problem.AddResidualBlock(RelativePoseError::Create(constraint.relativePosition, constraint.relativeOrientation, sqrtInformation)
+					, lossFunction.get()
+					, poseA.position
+					, poseA.orientation
+					, poseB.position
+					, poseB.orientation);
+				problem.SetParameterization(poseA.orientation, quaternionParameterization.get());
+				problem.SetParameterization(poseB.orientation, quaternionParameterization.get());
+				constraintAdded = true;
+			}
+			if (constraintAdded) {
+				lossFunction.release();
+				quaternionParameterization.release();
+			}
+
+			const size_t fixed = this->getFirstConstrainedPoseIndex();
+			if (fixed < this->poses.size()) {
+				problem.SetParameterBlockConstant(this->poses[fixed].position);
+				problem.SetParameterBlockConstant(this->poses[fixed].orientation);
+			}
+		}
+
+		//----------
+		// The first pose (in the order added) which is in a residual block, i.e. in a
+		// constraint whose poses both exist, or poses.size() if there is none
+		size_t getFirstConstrainedPoseIndex() const {
+			size_t first = this->poses.size();
+			for (const auto & constraint : this->constraints) {
+				const auto findA = this->poseIndices.find(constraint.idA);
+				const auto findB = this->poseIndices.find(constraint.idB);
+				if (findA == this->poseIndices.end() || findB == this->poseIndices.end()) {
+					continue;
+				}
+				first = std::min(first, std::min(findA->second, findB->second));
+			}
+			return first;
+		}
+
+		//----------
+		bool hasPose(int id) const {
+			return this->poseIndices.find(id) != this->poseIndices.end();
+		}
+
+		//----------
+		const Pose & getPose(int id) const {
+			return this->poses[this->poseIndices.at(id)];
+		}
+
+		//----------
+		const std::vector<Pose> & getPoses() const {
+			return this->poses;
+		}
+
+		//----------
+		const std::vector<Constraint> & getConstraints() const {
+			return this->constraints;
+		}
+
+		//----------
+		// Synthetic dataset in the manner of g2o's create_sphere: rings of poses round
+		// a sphere, each pose linked to the next (odometry) and to the pose one ring
+		// below (loop closures). Measurements get Gaussian noise and the initial guess
+		// is the spanning tree over them, so drift accumulates as in real odometry.
+		// groundTruth receives the noise free graph when given.
+		static PoseGraph createSphere(int rings
+			, int posesPerRing
+			, double radius = 100.0
+			, double positionSigma = 0.05
+			, double rotationSigma = 0.002
+			, unsigned int seed = 0
+			, PoseGraph * groundTruth = nullptr) {
+			PoseGraph truth;
+			for (int ring = 0; ring < rings; ring++) {
+				const double elevation = M_PI * ((ring + 0.5) / rings - 0.5);
+				for (int i = 0; i < posesPerRing; i++) {
+					const double azimuth = 2.0 * M_PI * i / posesPerRing;
+					const Eigen::Vector3d position(radius * std::cos(elevation) * std::cos(azimuth)
+						, radius * std::cos(elevation) * std::sin(azimuth)
+						, radius * std::sin(elevation));
+					const Eigen::Quaterniond orientation(Eigen::AngleAxisd(azimuth, Eigen::Vector3d::UnitZ())
+						* Eigen::AngleAxisd(-elevation, Eigen::Vector3d::UnitY()));
+					truth.addPose(ring * posesPerRing + i, position, orientation);
+				}
+			}
+
+			std::vector<std::pair<int, int>> edges;
+			const int count = rings * posesPerRing;
+			for (int id = 1; id < count; id++) {
+				edges.emplace_back(id - 1, id);
+				if (id >= posesPerRing) {
+					edges.emplace_back(id - posesPerRing, id);
+				}
+			}
+			return createNoisy(truth, edges, positionSigma, rotationSigma, seed, groundTruth);
+		}
+
+		//----------
+		// As createSphere, over a grid wrapped round a torus with each pose linked to
+		// its neighbours along both directions, including across the seams.
+		static PoseGraph createTorus(int rows
+			, int columns
+			, double majorRadius = 100.0
+			, double minorRadius = 30.0
+			, double positionSigma = 0.05
+			, double rotationSigma = 0.002
+			, unsigned int seed = 0
+			, PoseGraph * groundTruth = nullptr) {
+			PoseGraph truth;
+			for (int row = 0; row < rows; row++) {
+				const double u = 2.0 * M_PI * row / rows;
+				for (int column = 0; column < columns; column++) {
+					const double v = 2.0 * M_PI * column / columns;
+					const Eigen::Vector3d position((majorRadius + minorRadius * std::cos(v)) * std::cos(u)
+						, (majorRadius + minorRadius * std::cos(v)) * std::sin(u)
+						, minorRadius * std::sin(v));
+					const Eigen::Quaterniond orientation(Eigen::AngleAxisd(u, Eigen::Vector3d::UnitZ())
+						* Eigen::AngleAxisd(-v, Eigen::Vector3d::UnitY()));
+					truth.addPose(row * columns + column, position, orientation);
+				}
+			}
+
+			std::vector<std::pair<int, int>> edges;
+			for (int row = 0; row < rows; row++) {
+				for (int column = 0; column < columns; column++) {
+					const int id = row * columns + column;
+					edges.emplace_back(id, row * columns + (column + 1) % columns);
+					edges.emplace_back(id, ((row + 1) % rows) * columns + column);
+				}
+			}
+			return createNoisy(truth, edges, positionSigma, rotationSigma, seed, groundTruth);
+		}
+
+		//----------
+		// Root mean square position difference to another graph with the same pose ids
+		double getRmsPositionError(const PoseGraph & other) const {
+			double sum = 0.0;
+			size_t count = 0;
+			for (const auto & pose : this->poses) {
+				if (other.hasPose(pose.id)) {
+					sum += (pose.getPosition() - other.getPose(pose.id).getPosition()).squaredNorm();
+					count++;
+				}
+			}
+			return count > 0 ? std::sqrt(sum / (double) count) : 0.0;
+		}
+
+		struct BenchmarkResult {
+			std::string name;
+			size_t poseCount;
+			size_t constraintCount;
+			double solveSeconds;
+			ceres::Solver::Summary summary;
+			double initialRmsError;
+			double finalRmsError;
+		};
+
+		//----------
+		// Solves the sphere and torus datasets at each pose count (e.g. 10000, 100000)
+		static std::vector<BenchmarkResult> runBenchmark(const std::vector<int> & poseCounts) {
+			return runBenchmark(poseCounts, Settings());
+		}
+
+		//----------
+		static std::vector<BenchmarkResult> runBenchmark(const std::vector<int> & poseCounts
+			, const Settings & settings) {
+			std::vector<BenchmarkResult> results;
+			for (auto poseCount : poseCounts) {
+				const int side = std::max(2, (int) std::round(std::sqrt((double) poseCount)));
+				{
+					PoseGraph truth;
+					auto graph = createSphere(side, side, 100.0, 0.05, 0.002, 0, &truth);
+					results.push_back(runBenchmark("sphere", graph, truth, settings));
+				}
+				{
+					PoseGraph truth;
+					auto graph = createTorus(side, side, 100.0, 30.0, 0.05, 0.002, 0, &truth);
+					results.push_back(runBenchmark("torus", graph, truth, settings));
+				}
+			}
+			return results;
+		}
+
+		//----------
+		static std::string getBenchmarkReport(const std::vector<BenchmarkResult> & results) {
+			std::stringstream stream;
+			stream << std::setw(10) << "dataset"
+				<< std::setw(10) << "poses"
+				<< std::setw(12) << "edges"
+				<< std::setw(12) << "iterations"
+				<< std::setw(12) << "seconds"
+				<< std::setw(14) << "rms before"
+				<< std::setw(14) << "rms after" << std::endl;
+			for (const auto & result : results) {
+				stream << std::setw(10) << result.name
+					<< std::setw(10) << result.poseCount
+					<< std::setw(12) << result.constraintCount
+					<< std::setw(12) << result.summary.iterations.size()
+					<< std::setw(12) << std::fixed << std::setprecision(3) << result.solveSeconds
+					<< std::setw(14) << result.initialRmsError
+					<< std::setw(14) << result.finalRmsError << std::endl;
+			}
+			return stream.str();
+		}
+
+	protected:
+		//----------
+		static PoseGraph createNoisy(const PoseGraph & truth
+			, const std::vector<std::pair<int, int>> & edges
+			, double positionSigma
+			, double rotationSigma
+			, unsigned int seed
+			, PoseGraph * groundTruth) {
+			std::mt19937 random(seed);
+			std::normal_distribution<double> normal(0.0, 1.0);
+
+			Eigen::Matrix<double, 6, 6> information = Eigen::Matrix<double, 6, 6>::Zero();
+			information.diagonal() << Eigen::Vector3d::Constant(1.0 / (positionSigma * positionSigma))
+				, Eigen::Vector3d::Constant(1.0 / (rotationSigma * rotationSigma));
+
+			PoseGraph graph;
+			for (const auto & pose : truth.poses) {
+				graph.addPose(pose.id, pose.getPosition(), pose.getOrientation());
+			}
+			for (const auto & edge : edges) {
+				const auto & a = truth.getPose(edge.first);
+				const auto & b = truth.getPose(edge.second);
+				const Eigen::Quaterniond inverseA = a.getOrientation().conjugate();
+				Eigen::Vector3d relativePosition = inverseA * (b.getPosition() - a.getPosition());
+				Eigen::Quaterniond relativeOrientation = inverseA * b.getOrientation();
+
+				const Eigen::Vector3d positionNoise(normal(random), normal(random), normal(random));
+				const Eigen::Vector3d rotationNoise(normal(random), normal(random), normal(random));
+				relativePosition += positionNoise * positionSigma;
+				// small angle rotation
+				const Eigen::Vector3d halfAngle = rotationNoise * (0.5 * rotationSigma);
+				relativeOrientation = relativeOrientation * Eigen::Quaterniond(1.0, halfAngle.x(), halfAngle.y(), halfAngle.z()).normalized();
+
+				graph.addConstraint(edge.first, edge.second, relativePosition, relativeOrientation, information);
+			}
+			graph.initializeFromSpanningTree();
+
+			if (groundTruth) {
+				*groundTruth = truth;
+			}
+			return graph;
+		}
+
+		//----------
+		static BenchmarkResult runBenchmark(const std::string & name
+			, PoseGraph & graph
+			, const PoseGraph & truth
+			, const Settings & settings) {
+			BenchmarkResult result;
+			result.name = name;
+			result.poseCount = graph.poses.size();
+			result.constraintCount = graph.constraints.size();
+			result.initialRmsError = graph.getRmsPositionError(truth);
+
+			const auto startTime = std::chrono::high_resolution_clock::now();
+			result.summary = graph.solve(settings);
+			result.solveSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+			result.finalRmsError = graph.getRmsPositionError(truth);
+			return result;
+		}
+
+		//----------
+		static bool startsWith(const char * text, const char * prefix) {
+			return strncmp(text, prefix, strlen(prefix)) == 0;
+		}
+
+		//----------
+		static int parseValues(const char * text, double * values, int count) {
+			char * end;
+			for (int i = 0; i < count; i++) {
+				values[i] = std::strtod(text, &end);
+				if (end == text) {
+					return i;
+				}
+				text = end;
+			}
+			return count;
+		}
+
+		std::vector<Pose> poses;
+		std::unordered_map<int, size_t> poseIndices;
+		std::vector<Constraint> constraints;
+	};
+}
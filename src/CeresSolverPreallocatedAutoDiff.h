@@ -0,0 +1,168 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+
+#include <ceres/internal/fixed_array.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Drop in for ceres::DynamicAutoDiffCostFunction (same functor signature,
+	// same strided evaluation) whose sizes are given at construction, so all
+	// Jet scratch is allocated up front and Evaluate never touches the heap.
+	//
+	// Scratch comes in slots, one per concurrent evaluation. Set
+	// maxConcurrentEvaluations to the solver's num_threads (0 = hardware concurrency).
+	//
+	//	auto costFunction = new PreallocatedAutoDiffCostFunction<MyFunctor>(new MyFunctor(...)
+	//		, { 3, 3, 3 } // parameter block sizes
+	//		, 3); // residuals
+	template<typename Functor, int Stride = 4>
+	class PreallocatedAutoDiffCostFunction : public ceres::CostFunction {
+	public:
+		typedef ceres::Jet<double, Stride> JetType;
+
+		//----------
+		PreallocatedAutoDiffCostFunction(Functor * functor
+			, const std::vector<int> & parameterBlockSizes
+			, int numResiduals
+			, int maxConcurrentEvaluations = 0)
+			: functor(functor) {
+			*this->mutable_parameter_block_sizes() = parameterBlockSizes;
+			this->set_num_residuals(numResiduals);
+
+			int parameterCount = 0;
+			for (auto size : parameterBlockSizes) {
+				parameterCount += size;
+			}
+
+			if (maxConcurrentEvaluations <= 0) {
+				maxConcurrentEvaluations = std::max(1, (int) std::thread::hardware_concurrency());
+			}
+			this->slotCount = maxConcurrentEvaluations;
+			this->slots.reset(new std::unique_ptr<Scratch>[this->slotCount]);
+			this->slotsInUse.reset(new std::atomic<bool>[this->slotCount]);
+			for (int i = 0; i < this->slotCount; i++) {
+				this->slots[i].reset(new Scratch(parameterCount, numResiduals, (int) parameterBlockSizes.size()));
+				this->slotsInUse[i] = false;
+			}
+		}
+
+		//----------
+		bool Evaluate(double const * const * parameters
+			, double * residuals
+			, double ** jacobians) const override {
+			if (jacobians == NULL) {
+				return (*this->functor)(parameters, residuals);
+			}
+
+			SlotLock lock(*this);
+			auto & scratch = *lock.scratch;
+			const auto & blockSizes = this->parameter_block_sizes();
+			const int residualCount = this->num_residuals();
+
+			// values, and which parameters want derivatives
+			int activeCount = 0;
+			int cursor = 0;
+			for (int block = 0; block < (int) blockSizes.size(); block++) {
+				scratch.jetParameters[block] = scratch.inputJets.get() + cursor;
+				for (int i = 0; i < blockSizes[block]; i++, cursor++) {
+					scratch.inputJets[cursor].a = parameters[block][i];
+					scratch.inputJets[cursor].v.setZero();
+					if (jacobians[block] != NULL) {
+						scratch.activeParameters[activeCount] = cursor;
+						scratch.activeBlocks[activeCount] = block;
+						scratch.activeOffsets[activeCount] = i;
+						activeCount++;
+					}
+				}
+			}
+
+			// Stride derivatives per pass
+			int begin = 0;
+			do {
+				const int end = std::min(begin + Stride, activeCount);
+				for (int k = begin; k < end; k++) {
+					scratch.inputJets[scratch.activeParameters[k]].v[k - begin] = 1.0;
+				}
+
+				if (!(*this->functor)(scratch.jetParameters.get(), scratch.outputJets.get())) {
+					return false;
+				}
+
+				for (int k = begin; k < end; k++) {
+					const int block = scratch.activeBlocks[k];
+					const int blockSize = blockSizes[block];
+					const int offset = scratch.activeOffsets[k];
+					for (int residual = 0; residual < residualCount; residual++) {
+						jacobians[block][residual * blockSize + offset] = scratch.outputJets[residual].v[k - begin];
+					}
+					scratch.inputJets[scratch.activeParameters[k]].v[k - begin] = 0.0;
+				}
+				begin = end;
+			} while (begin < activeCount);
+
+			for (int residual = 0; residual < residualCount; residual++) {
+				residuals[residual] = scratch.outputJets[residual].a;
+			}
+			return true;
+		}
+
+	protected:
+		struct Scratch {
+			Scratch(int parameterCount, int residualCount, int blockCount)
+				: inputJets(parameterCount)
+				, outputJets(residualCount)
+				, jetParameters(blockCount)
+				, activeParameters(parameterCount)
+				, activeBlocks(parameterCount)
+				, activeOffsets(parameterCount) {}
+
+			ceres::internal::FixedArray<JetType> inputJets;
+			ceres::internal::FixedArray<JetType> outputJets;
+			ceres::internal::FixedArray<JetType *> jetParameters;
+			ceres::internal::FixedArray<int> activeParameters; // index into inputJets
+			ceres::internal::FixedArray<int> activeBlocks;
+			ceres::internal::FixedArray<int> activeOffsets; // within the block
+		};
+
+		//----------
+		// Claims a free slot for the scope of one evaluation
+		struct SlotLock {
+			SlotLock(const PreallocatedAutoDiffCostFunction & owner)
+				: owner(owner) {
+				while (true) {
+					for (int i = 0; i < owner.slotCount; i++) {
+						bool expected = false;
+						if (!owner.slotsInUse[i].load(std::memory_order_relaxed)
+							&& owner.slotsInUse[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+							this->index = i;
+							this->scratch = owner.slots[i].get();
+							return;
+						}
+					}
+					// more evaluating threads than slots
+					std::this_thread::yield();
+				}
+			}
+
+			~SlotLock() {
+				this->owner.slotsInUse[this->index].store(false, std::memory_order_release);
+			}
+
+			const PreallocatedAutoDiffCostFunction & owner;
+			int index;
+			Scratch * scratch;
+		};
+
+		std::unique_ptr<Functor> functor;
+		int slotCount;
+		std::unique_ptr<std::unique_ptr<Scratch>[]> slots;
+		std::unique_ptr<std::atomic<bool>[]> slotsInUse;
+	};
+}
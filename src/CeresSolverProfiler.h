@@ -0,0 +1,278 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+namespace ofxCeresSolver {
+	//----------
+	// Finds which residual type makes a solve slow. Wrap cost functions as they
+	// are added and read the report after the solve:
+	//
+	//	CostFunctionProfiler profiler;
+	//	problem.AddResidualBlock(profiler.wrap(RigidBodyTransformError::Create(a, b)), NULL, parameters);
+	//	ceres::Solve(options, &problem, &summary);
+	//	cout << profiler.getReportString();
+	//
+	// Counters are per thread and only summed in getReport, so evaluations on
+	// different solver threads never contend.
+	class CostFunctionProfiler {
+	public:
+		struct Entry {
+			std::string name;
+			size_t residualBlocks = 0;
+			uint64_t calls = 0;
+			uint64_t jacobianCalls = 0; // included in calls
+			uint64_t failures = 0; // Evaluate returned false
+			uint64_t nonFiniteJacobians = 0;
+			double residualSeconds = 0.0; // evaluations without Jacobians
+			double jacobianSeconds = 0.0; // evaluations with Jacobians
+
+			//----------
+			double getTotalSeconds() const {
+				return this->residualSeconds + this->jacobianSeconds;
+			}
+		};
+
+		//----------
+		CostFunctionProfiler()
+			: id(nextId()) {}
+
+		CostFunctionProfiler(const CostFunctionProfiler &) = delete;
+		CostFunctionProfiler & operator=(const CostFunctionProfiler &) = delete;
+
+		//----------
+		// Keyed by the dynamic type of the cost function, e.g.
+		// ceres::AutoDiffCostFunction<ofxCeresSolver::RigidBodyTransformError, 3, 6>
+		ceres::CostFunction * wrap(ceres::CostFunction * costFunction
+			, ceres::Ownership ownership = ceres::TAKE_OWNERSHIP) {
+			return this->wrap(costFunction, demangle(typeid(*costFunction).name()), ownership);
+		}
+
+		//----------
+		ceres::CostFunction * wrap(ceres::CostFunction * costFunction
+			, const std::string & name
+			, ceres::Ownership ownership = ceres::TAKE_OWNERSHIP) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			auto findName = this->nameIndices.find(name);
+			size_t index;
+			if (findName == this->nameIndices.end()) {
+				index = this->entries.size();
+				this->nameIndices[name] = index;
+				this->entries.emplace_back();
+				this->entries.back().name = name;
+			}
+			else {
+				index = findName->second;
+			}
+			this->entries[index].residualBlocks++;
+			return new ProfiledCostFunction(*this, index, costFunction, ownership);
+		}
+
+		//----------
+		// Sums the thread counters. Call once the solve has returned.
+		std::vector<Entry> getReport() const {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			auto report = this->entries;
+			for (const auto & threadCounters : this->threadCounters) {
+				for (size_t i = 0; i < threadCounters->size(); i++) {
+					const auto & counters = (*threadCounters)[i];
+					auto & entry = report[i];
+					entry.calls += counters.calls;
+					entry.jacobianCalls += counters.jacobianCalls;
+					entry.failures += counters.failures;
+					entry.nonFiniteJacobians += counters.nonFiniteJacobians;
+					entry.residualSeconds += counters.residualSeconds;
+					entry.jacobianSeconds += counters.jacobianSeconds;
+				}
+			}
+			std::sort(report.begin(), report.end(), [](const Entry & a, const Entry & b) {
+				return a.getTotalSeconds() > b.getTotalSeconds();
+			});
+			return report;
+		}
+
+		//----------
+		std::string getReportString() const {
+			std::stringstream stream;
+			stream << std::setw(10) << "blocks"
+				<< std::setw(12) << "calls"
+				<< std::setw(12) << "jacobians"
+				<< std::setw(14) << "residual ms"
+				<< std::setw(14) << "jacobian ms"
+				<< std::setw(10) << "us/call"
+				<< std::setw(12) << "failures"
+				<< std::setw(12) << "non finite"
+				<< "  cost function" << std::endl;
+			for (const auto & entry : this->getReport()) {
+				stream << std::setw(10) << entry.residualBlocks
+					<< std::setw(12) << entry.calls
+					<< std::setw(12) << entry.jacobianCalls
+					<< std::setw(14) << std::fixed << std::setprecision(3) << entry.residualSeconds * 1000.0
+					<< std::setw(14) << entry.jacobianSeconds * 1000.0
+					<< std::setw(10) << (entry.calls > 0 ? entry.getTotalSeconds() * 1e6 / (double) entry.calls : 0.0)
+					<< std::setw(12) << entry.failures
+					<< std::setw(12) << entry.nonFiniteJacobians
+					<< "  " << entry.name << std::endl;
+			}
+			return stream.str();
+		}
+
+		//----------
+		// Clears the counters, keeping the wrapped cost functions
+		void resetCounters() {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			for (auto & threadCounters : this->threadCounters) {
+				for (auto & counters : *threadCounters) {
+					counters = Counters();
+				}
+			}
+		}
+
+	protected:
+		struct Counters {
+			uint64_t calls = 0;
+			uint64_t jacobianCalls = 0;
+			uint64_t failures = 0;
+			uint64_t nonFiniteJacobians = 0;
+			double residualSeconds = 0.0;
+			double jacobianSeconds = 0.0;
+		};
+
+		typedef std::vector<Counters> ThreadCounters; // indexed like entries
+
+		//----------
+		class ProfiledCostFunction : public ceres::CostFunction {
+		public:
+			//----------
+			ProfiledCostFunction(CostFunctionProfiler & profiler
+				, size_t index
+				, ceres::CostFunction * costFunction
+				, ceres::Ownership ownership)
+				: profiler(profiler)
+				, index(index)
+				, costFunction(costFunction)
+				, ownership(ownership) {
+				*this->mutable_parameter_block_sizes() = costFunction->parameter_block_sizes();
+				this->set_num_residuals(costFunction->num_residuals());
+			}
+
+			//----------
+			~ProfiledCostFunction() {
+				if (this->ownership == ceres::TAKE_OWNERSHIP) {
+					delete this->costFunction;
+				}
+			}
+
+			//----------
+			bool Evaluate(double const * const * parameters
+				, double * residuals
+				, double ** jacobians) const override {
+				const auto startTime = std::chrono::steady_clock::now();
+				const bool succeeded = this->costFunction->Evaluate(parameters, residuals, jacobians);
+				const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+				auto & counters = this->profiler.getThreadCounters(this->index);
+				counters.calls++;
+				if (!succeeded) {
+					counters.failures++;
+				}
+				if (jacobians) {
+					counters.jacobianCalls++;
+					counters.jacobianSeconds += seconds;
+					if (succeeded && !this->isFinite(jacobians)) {
+						counters.nonFiniteJacobians++;
+					}
+				}
+				else {
+					counters.residualSeconds += seconds;
+				}
+				return succeeded;
+			}
+
+		protected:
+			//----------
+			bool isFinite(double ** jacobians) const {
+				const auto & blockSizes = this->parameter_block_sizes();
+				for (size_t block = 0; block < blockSizes.size(); block++) {
+					if (!jacobians[block]) {
+						continue;
+					}
+					const int count = blockSizes[block] * this->num_residuals();
+					for (int i = 0; i < count; i++) {
+						if (!std::isfinite(jacobians[block][i])) {
+							return false;
+						}
+					}
+				}
+				return true;
+			}
+
+			CostFunctionProfiler & profiler;
+			size_t index;
+			ceres::CostFunction * costFunction;
+			ceres::Ownership ownership;
+		};
+
+		//----------
+		// This thread's counters for a cost function type. Only the first call per
+		// thread (and per new type) takes the lock.
+		Counters & getThreadCounters(size_t index) {
+			// keyed by id rather than address, so a profiler created at the address
+			// of a destroyed one does not pick up its stale entry
+			thread_local std::unordered_map<uint64_t, ThreadCounters *> threadCountersById;
+			auto & threadCounters = threadCountersById[this->id];
+			if (!threadCounters || index >= threadCounters->size()) {
+				std::lock_guard<std::mutex> lock(this->mutex);
+				if (!threadCounters) {
+					this->threadCounters.emplace_back(new ThreadCounters());
+					threadCounters = this->threadCounters.back().get();
+				}
+				threadCounters->resize(this->entries.size());
+			}
+			return (*threadCounters)[index];
+		}
+
+		//----------
+		static uint64_t nextId() {
+			static std::atomic<uint64_t> id(0);
+			return id++;
+		}
+
+		//----------
+		static std::string demangle(const char * name) {
+#ifdef __GNUG__
+			int status = 0;
+			char * demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+			if (status == 0 && demangled) {
+				std::string result(demangled);
+				std::free(demangled);
+				return result;
+			}
+#endif
+			return name;
+		}
+
+		const uint64_t id;
+		mutable std::mutex mutex;
+		std::vector<Entry> entries;
+		std::unordered_map<std::string, size_t> nameIndices;
+		std::vector<std::unique_ptr<ThreadCounters>> threadCounters;
+	};
+}
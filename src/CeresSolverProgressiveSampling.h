@@ -0,0 +1,147 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverCostFunctions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Progressive sampling for problems with very many independent residual blocks.
+	// The solve runs in stages over a growing random subset of the blocks (nested,
+	// so every stage warm starts from a superset of what the previous one saw).
+	// Each stage runs until it converges at a loose tolerance, then the subset
+	// grows by growthFactor. A final stage over all blocks at the full solver
+	// options verifies the result, and normally needs only a couple of iterations.
+	class ProgressiveSampling {
+	public:
+		// adds the residual block for one input index to the problem
+		typedef std::function<void(ceres::Problem & problem, size_t index, double * parameters)> AddResidualBlock;
+
+		struct Settings {
+			size_t initialSampleCount = 1000;
+			double growthFactor = 4.0;
+			int maxIterationsPerStage = 10;
+			double stageFunctionTolerance = 1e-4;
+			unsigned int seed = 0;
+
+			// also solve on the full data from the same initial guess to report the speedup
+			bool compareWithFullSolve = false;
+
+			ceres::Solver::Options solverOptions; // used as is for the final stage
+		};
+
+		struct Stage {
+			size_t sampleCount;
+			int iterations;
+			double cost;
+			double seconds;
+		};
+
+		struct Result {
+			std::vector<Stage> stages; // the last one is the full verification pass
+			ceres::Solver::Summary finalSummary;
+			double seconds = 0.0; // all stages including problem construction
+
+			// only when compareWithFullSolve is set
+			double fullSolveSeconds = 0.0;
+			double fullSolveCost = 0.0;
+			double speedup = 0.0;
+		};
+
+		//----------
+		Result solve(size_t count
+			, const AddResidualBlock & addResidualBlock
+			, double * parameters
+			, int parameterCount
+			, const Settings & settings) {
+			Result result;
+
+			std::vector<double> initialParameters(parameters, parameters + parameterCount);
+
+			// a shuffled prefix of this is the sample at each stage
+			std::vector<size_t> order(count);
+			std::iota(order.begin(), order.end(), (size_t) 0);
+			std::mt19937 random(settings.seed);
+			std::shuffle(order.begin(), order.end(), random);
+
+			auto stageOptions = settings.solverOptions;
+			stageOptions.max_num_iterations = settings.maxIterationsPerStage;
+			stageOptions.function_tolerance = std::max(settings.stageFunctionTolerance, settings.solverOptions.function_tolerance);
+			stageOptions.minimizer_progress_to_stdout = false;
+
+			const auto startTime = std::chrono::high_resolution_clock::now();
+
+			size_t sampleCount = std::max((size_t) 1, settings.initialSampleCount);
+			while (sampleCount < count) {
+				ceres::Solver::Summary summary;
+				result.stages.push_back(solveStage(order, sampleCount, addResidualBlock, parameters, stageOptions, summary));
+				sampleCount = (size_t) ((double) sampleCount * std::max(settings.growthFactor, 1.5));
+			}
+
+			// verification over everything
+			result.stages.push_back(solveStage(order, count, addResidualBlock, parameters, settings.solverOptions, result.finalSummary));
+
+			result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+			if (settings.compareWithFullSolve) {
+				auto fullParameters = initialParameters;
+				ceres::Solver::Summary summary;
+				const auto fullStage = solveStage(order, count, addResidualBlock, fullParameters.data(), settings.solverOptions, summary);
+				result.fullSolveSeconds = fullStage.seconds;
+				result.fullSolveCost = fullStage.cost;
+				result.speedup = result.seconds > 0.0
+					? result.fullSolveSeconds / result.seconds
+					: 0.0;
+			}
+
+			return result;
+		}
+
+		//----------
+		// Rigid body solve over point pairs with RigidBodyTransformError
+		Result solve(const std::vector<glm::vec3> & untransformedPoints
+			, const std::vector<glm::vec3> & transformedPoints
+			, double * parameters
+			, const Settings & settings) {
+			return this->solve(std::min(untransformedPoints.size(), transformedPoints.size())
+				, [&](ceres::Problem & problem, size_t index, double * parameters) {
+					problem.AddResidualBlock(RigidBodyTransformError::Create(untransformedPoints[index], transformedPoints[index])
+						, NULL
+						, parameters);
+				}
+				, parameters
+				, 6
+				, settings);
+		}
+
+	protected:
+		//----------
+		static Stage solveStage(const std::vector<size_t> & order
+			, size_t sampleCount
+			, const AddResidualBlock & addResidualBlock
+			, double * parameters
+			, const ceres::Solver::Options & options
+			, ceres::Solver::Summary & summary) {
+			const auto startTime = std::chrono::high_resolution_clock::now();
+
+			ceres::Problem problem;
+			for (size_t i = 0; i < sampleCount; i++) {
+				addResidualBlock(problem, order[i], parameters);
+			}
+			ceres::Solve(options, &problem, &summary);
+
+			Stage stage;
+			stage.sampleCount = sampleCount;
+			stage.iterations = (int) summary.iterations.size();
+			stage.cost = summary.final_cost;
+			stage.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+			return stage;
+		}
+	};
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverCostFunctions.h"
+
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Tracks many marker based rigid bodies in one persistent ceres::Problem.
+	// Each body owns one 6 parameter block (as RigidBodyTransformError) which
+	// carries over between frames as the warm start. A residual block exists for
+	// each marker while it is visible, and it is only added or removed when the
+	// marker appears or drops out. Visible markers just have their observed
+	// position updated in place, so a steady frame does no Problem rebuilding.
+	class RigidBodyTracker {
+	public:
+		typedef size_t BodyID;
+
+		struct Settings {
+			// bodies with fewer visible markers keep their last pose
+			size_t minimumVisibleMarkers = 3;
+
+			// Huber loss scale against marker swaps. 0 = plain least squares
+			double lossScale = 0.0;
+
+			ceres::Solver::Options solverOptions = defaultSolverOptions();
+		};
+
+		//----------
+		static ceres::Solver::Options defaultSolverOptions() {
+			ceres::Solver::Options options;
+			// Bodies share no parameters so JtJ is block diagonal with 6x6 blocks
+			options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = 10;
+			// only has an effect if the linked ceres was built with threads
+			options.num_threads = std::max(1, (int) std::thread::hardware_concurrency());
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+			return options;
+		}
+
+		//----------
+		RigidBodyTracker()
+			: RigidBodyTracker(Settings()) {
+		}
+
+		//----------
+		RigidBodyTracker(const Settings & settings)
+			: settings(settings)
+			, problem(problemOptions()) {
+			if (this->settings.lossScale > 0.0) {
+				this->lossFunction.reset(new ceres::HuberLoss(this->settings.lossScale));
+			}
+		}
+
+		//----------
+		// markerPositions are in body space. The body starts at initialTransformParameters
+		// (translation, euler rotation) or identity.
+		BodyID addBody(const std::vector<glm::vec3> & markerPositions, const double * initialTransformParameters = nullptr) {
+			this->bodies.emplace_back();
+			auto & body = this->bodies.back();
+			for (int i = 0; i < 6; i++) {
+				body.parameters[i] = initialTransformParameters ? initialTransformParameters[i] : 0.0;
+			}
+			body.markerPositions.assign(markerPositions.begin(), markerPositions.end());
+			body.markers.resize(markerPositions.size());
+
+			this->problem.AddParameterBlock(body.parameters, 6);
+			this->problem.SetParameterBlockConstant(body.parameters);
+			body.constant = true;
+
+			return this->bodies.size() - 1;
+		}
+
+		//----------
+		void removeBody(BodyID bodyID) {
+			auto & body = this->bodies.at(bodyID);
+			if (body.removed) {
+				return;
+			}
+			for (size_t i = 0; i < body.markers.size(); i++) {
+				this->dropMarker(bodyID, i);
+			}
+			this->problem.RemoveParameterBlock(body.parameters);
+			body.removed = true;
+		}
+
+		//----------
+		size_t getBodyCount() const {
+			return this->bodies.size();
+		}
+
+		//----------
+		// Observed world position of a marker this frame. Ignored for removed bodies,
+		// whose parameter block is no longer in the problem.
+		void setMarker(BodyID bodyID, size_t markerIndex, const glm::vec3 & observedPosition) {
+			auto & body = this->bodies.at(bodyID);
+			if (body.removed) {
+				return;
+			}
+			auto & marker = body.markers.at(markerIndex);
+			if (marker.residualBlock) {
+				marker.functor->transformedPoint = observedPosition;
+				return;
+			}
+
+			marker.functor = new RigidBodyTransformError(body.markerPositions[markerIndex], observedPosition);
+			marker.residualBlock = this->problem.AddResidualBlock(new ceres::AutoDiffCostFunction<RigidBodyTransformError, 3, 6>(marker.functor)
+				, this->lossFunction.get()
+				, body.parameters);
+			body.visibleMarkers++;
+		}
+
+		//----------
+		// Marker is occluded this frame
+		void dropMarker(BodyID bodyID, size_t markerIndex) {
+			auto & body = this->bodies.at(bodyID);
+			auto & marker = body.markers.at(markerIndex);
+			if (!marker.residualBlock) {
+				return;
+			}
+
+			// the problem owns and deletes the cost function and with it the functor
+			this->problem.RemoveResidualBlock(marker.residualBlock);
+			marker.residualBlock = nullptr;
+			marker.functor = nullptr;
+			body.visibleMarkers--;
+		}
+
+		//----------
+		// Convenience for a whole body. Markers with visible[i] == false are dropped.
+		// Nothing changes if visible and observedPositions differ in size.
+		void setMarkers(BodyID bodyID, const std::vector<glm::vec3> & observedPositions, const std::vector<bool> & visible) {
+			if (visible.size() != observedPositions.size()) {
+				return;
+			}
+			for (size_t i = 0; i < observedPositions.size(); i++) {
+				if (visible[i]) {
+					this->setMarker(bodyID, i, observedPositions[i]);
+				}
+				else {
+					this->dropMarker(bodyID, i);
+				}
+			}
+		}
+
+		//----------
+		ceres::Solver::Summary solve() {
+			// only bodies with enough markers are free to move
+			for (auto & body : this->bodies) {
+				if (body.removed) {
+					continue;
+				}
+				const bool constant = body.visibleMarkers < this->settings.minimumVisibleMarkers;
+				if (constant != body.constant) {
+					if (constant) {
+						this->problem.SetParameterBlockConstant(body.parameters);
+					}
+					else {
+						this->problem.SetParameterBlockVariable(body.parameters);
+					}
+					body.constant = constant;
+				}
+			}
+
+			ceres::Solver::Summary summary;
+			if (this->problem.NumResidualBlocks() > 0) {
+				ceres::Solve(this->settings.solverOptions, &this->problem, &summary);
+			}
+			return summary;
+		}
+
+		//----------
+		// False if the body was held at its last pose in the latest solve
+		bool isTracked(BodyID bodyID) const {
+			const auto & body = this->bodies.at(bodyID);
+			return !body.removed && !body.constant;
+		}
+
+		//----------
+		const double * getTransformParameters(BodyID bodyID) const {
+			return this->bodies.at(bodyID).parameters;
+		}
+
+		//----------
+		// Body space to world space
+		glm::mat4 getTransform(BodyID bodyID) const {
+			const auto parameters = this->getTransformParameters(bodyID);
+			glm::tvec3<double> translation(parameters[0], parameters[1], parameters[2]);
+			glm::tvec3<double> rotationVector(parameters[3], parameters[4], parameters[5]);
+			return glm::mat4(VectorMath::createTransform(translation, rotationVector));
+		}
+
+		//----------
+		ceres::Problem & getProblem() {
+			return this->problem;
+		}
+
+	protected:
+		//----------
+		static ceres::Problem::Options problemOptions() {
+			ceres::Problem::Options options;
+			// O(1) RemoveResidualBlock at the cost of a little memory
+			options.enable_fast_removal = true;
+			options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+			return options;
+		}
+
+		struct Marker {
+			ceres::ResidualBlockId residualBlock = nullptr;
+			RigidBodyTransformError * functor = nullptr; // owned by the problem
+		};
+
+		struct Body {
+			double parameters[6];
+			std::vector<glm::tvec3<double>> markerPositions;
+			std::vector<Marker> markers;
+			size_t visibleMarkers = 0;
+			bool constant = true;
+			bool removed = false;
+		};
+
+		Settings settings;
+		std::unique_ptr<ceres::LossFunction> lossFunction; // declared before problem so it outlives it
+		ceres::Problem problem;
+
+		// deque keeps each body's parameter block at a stable address
+		std::deque<Body> bodies;
+	};
+}
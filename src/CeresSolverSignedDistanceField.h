@@ -0,0 +1,624 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverThreadPool.h"
+
+#include "ofMesh.h"
+
+#include <ceres/cubic_interpolation.h>
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Dense 3D grid of scalars for TriCubicInterpolator, stored in cubic bricks of
+	// kBrickSize^3 samples. A tricubic evaluation reads a 4x4x4 stencil, which in a
+	// row major volume is 16 rows far apart in memory; in bricks the stencil lies in
+	// at most 8 neighbouring bricks and with the default 4^3 bricks each brick is
+	// 64 samples (4 cache lines of floats). Positions outside the grid take the value
+	// of the nearest edge, as ceres::Grid2D.
+	template<typename T = float, int kBrickSize = 4>
+	class Grid3D {
+	public:
+		static_assert(kBrickSize > 0 && (kBrickSize & (kBrickSize - 1)) == 0, "Brick size must be a power of 2");
+
+		enum { DATA_DIMENSION = 1 };
+
+		//----------
+		Grid3D() {}
+
+		//----------
+		Grid3D(int sizeX, int sizeY, int sizeZ, T value = T()) {
+			this->allocate(sizeX, sizeY, sizeZ, value);
+		}
+
+		//----------
+		void allocate(int sizeX, int sizeY, int sizeZ, T value = T()) {
+			this->sizeX = std::max(sizeX, 1);
+			this->sizeY = std::max(sizeY, 1);
+			this->sizeZ = std::max(sizeZ, 1);
+			this->bricksX = (this->sizeX + kBrickSize - 1) / kBrickSize;
+			this->bricksY = (this->sizeY + kBrickSize - 1) / kBrickSize;
+			const int bricksZ = (this->sizeZ + kBrickSize - 1) / kBrickSize;
+			this->data.assign((size_t) this->bricksX * this->bricksY * bricksZ * kBrickSize * kBrickSize * kBrickSize, value);
+		}
+
+		//----------
+		EIGEN_STRONG_INLINE void GetValue(int x, int y, int z, double * f) const {
+			x = std::min(std::max(x, 0), this->sizeX - 1);
+			y = std::min(std::max(y, 0), this->sizeY - 1);
+			z = std::min(std::max(z, 0), this->sizeZ - 1);
+			f[0] = static_cast<double>(this->data[this->getIndex(x, y, z)]);
+		}
+
+		//----------
+		// No bounds checks
+		T get(int x, int y, int z) const {
+			return this->data[this->getIndex(x, y, z)];
+		}
+
+		//----------
+		void set(int x, int y, int z, T value) {
+			this->data[this->getIndex(x, y, z)] = value;
+		}
+
+		//----------
+		int getSizeX() const {
+			return this->sizeX;
+		}
+
+		//----------
+		int getSizeY() const {
+			return this->sizeY;
+		}
+
+		//----------
+		int getSizeZ() const {
+			return this->sizeZ;
+		}
+
+	protected:
+		//----------
+		size_t getIndex(int x, int y, int z) const {
+			const int mask = kBrickSize - 1;
+			const size_t brick = ((size_t) (z / kBrickSize) * this->bricksY + y / kBrickSize) * this->bricksX + x / kBrickSize;
+			return brick * (kBrickSize * kBrickSize * kBrickSize)
+				+ ((z & mask) * kBrickSize + (y & mask)) * kBrickSize + (x & mask);
+		}
+
+		int sizeX = 1;
+		int sizeY = 1;
+		int sizeZ = 1;
+		int bricksX = 1;
+		int bricksY = 1;
+		std::vector<T> data = std::vector<T>(kBrickSize * kBrickSize * kBrickSize);
+	};
+
+	//----------
+	// The 3D counterpart of ceres::BiCubicInterpolator: Catmull-Rom splines along
+	// x, then y, then z over the 4x4x4 samples around the point, with derivatives.
+	// The Grid provides DATA_DIMENSION and GetValue(x, y, z, double * f).
+	template<typename Grid>
+	class TriCubicInterpolator {
+	public:
+		typedef Eigen::Matrix<double, Grid::DATA_DIMENSION, 1> Value;
+
+		//----------
+		explicit TriCubicInterpolator(const Grid & grid)
+			: grid(grid) {}
+
+		//----------
+		// The point is assumed to lie in the cell between samples floor(x) and floor(x) + 1
+		// (and so on for y and z). Any of the derivatives can be NULL.
+		void Evaluate(double x, double y, double z
+			, double * f
+			, double * dfdx
+			, double * dfdy
+			, double * dfdz) const {
+			const int ix = (int) std::floor(x);
+			const int iy = (int) std::floor(y);
+			const int iz = (int) std::floor(z);
+			const double fx = x - ix;
+			const double fy = y - iy;
+			const double fz = z - iz;
+
+			Value p[4];
+			Value alongX[4][4], alongXdx[4][4];
+			for (int k = 0; k < 4; k++) {
+				for (int j = 0; j < 4; j++) {
+					for (int i = 0; i < 4; i++) {
+						this->grid.GetValue(ix + i - 1, iy + j - 1, iz + k - 1, p[i].data());
+					}
+					ceres::CubicHermiteSpline<Grid::DATA_DIMENSION>(p[0], p[1], p[2], p[3], fx
+						, alongX[k][j].data(), alongXdx[k][j].data());
+				}
+			}
+
+			Value alongY[4], alongYdx[4], alongYdy[4];
+			for (int k = 0; k < 4; k++) {
+				ceres::CubicHermiteSpline<Grid::DATA_DIMENSION>(alongX[k][0], alongX[k][1], alongX[k][2], alongX[k][3], fy
+					, alongY[k].data(), alongYdy[k].data());
+				if (dfdx) {
+					ceres::CubicHermiteSpline<Grid::DATA_DIMENSION>(alongXdx[k][0], alongXdx[k][1], alongXdx[k][2], alongXdx[k][3], fy
+						, alongYdx[k].data(), NULL);
+				}
+			}
+
+			ceres::CubicHermiteSpline<Grid::DATA_DIMENSION>(alongY[0], alongY[1], alongY[2], alongY[3], fz, f, dfdz);
+			if (dfdx) {
+				ceres::CubicHermiteSpline<Grid::DATA_DIMENSION>(alongYdx[0], alongYdx[1], alongYdx[2], alongYdx[3], fz, dfdx, NULL);
+			}
+			if (dfdy) {
+				ceres::CubicHermiteSpline<Grid::DATA_DIMENSION>(alongYdy[0], alongYdy[1], alongYdy[2], alongYdy[3], fz, dfdy, NULL);
+			}
+		}
+
+		//----------
+		// The following two overloads interface with automatic differentiation,
+		// as in ceres::BiCubicInterpolator
+		void Evaluate(const double & x, const double & y, const double & z, double * f) const {
+			this->Evaluate(x, y, z, f, NULL, NULL, NULL);
+		}
+
+		//----------
+		template<typename JetT>
+		void Evaluate(const JetT & x, const JetT & y, const JetT & z, JetT * f) const {
+			double value[Grid::DATA_DIMENSION];
+			double dfdx[Grid::DATA_DIMENSION];
+			double dfdy[Grid::DATA_DIMENSION];
+			double dfdz[Grid::DATA_DIMENSION];
+			this->Evaluate(x.a, y.a, z.a, value, dfdx, dfdy, dfdz);
+			for (int i = 0; i < Grid::DATA_DIMENSION; i++) {
+				f[i].a = value[i];
+				f[i].v = dfdx[i] * x.v + dfdy[i] * y.v + dfdz[i] * z.v;
+			}
+		}
+
+	protected:
+		const Grid & grid;
+	};
+
+	//----------
+	// Signed distance to a closed triangle mesh (e.g. the CAD model of a prop),
+	// sampled on a Grid3D and read back with tricubic interpolation. Negative inside.
+	// The sign comes from the generalized winding number, so the mesh may have
+	// either triangle orientation and small cracks.
+	class SignedDistanceField {
+	public:
+		typedef Grid3D<float> GridType;
+
+		//----------
+		SignedDistanceField()
+			: interpolator(grid) {}
+
+		SignedDistanceField(const SignedDistanceField &) = delete;
+		SignedDistanceField & operator=(const SignedDistanceField &) = delete;
+
+		//----------
+		// Samples the mesh's bounding box grown by padding (in mesh units) on every side.
+		// The padding should cover the expected misalignment, since the field is
+		// flat beyond the grid. The triangles are put in a bounding volume hierarchy
+		// once, then each sample searches it for the nearest triangle and sums the
+		// winding number over it, split over the pool.
+		// Returns false (leaving the field unchanged) if voxelSize is not positive.
+		bool build(const ofMesh & mesh
+			, float voxelSize
+			, float padding
+			, ThreadPool & threadPool = ThreadPool::getShared()) {
+			if (!(voxelSize > 0.0f)) {
+				return false;
+			}
+
+			TriangleTree tree;
+			tree.build(getTriangles(mesh));
+
+			glm::tvec3<double> minimum(0.0);
+			glm::tvec3<double> maximum(0.0);
+			tree.getBounds(minimum, maximum);
+
+			this->voxelSize = voxelSize;
+			this->origin = minimum - glm::tvec3<double>(padding);
+			const auto size = (maximum - minimum + glm::tvec3<double>(2.0 * padding)) / (double) voxelSize;
+			this->grid.allocate((int) std::ceil(size.x) + 1
+				, (int) std::ceil(size.y) + 1
+				, (int) std::ceil(size.z) + 1);
+
+			const int sizeX = this->grid.getSizeX();
+			const int sizeY = this->grid.getSizeY();
+			threadPool.parallelFor((size_t) sizeY * this->grid.getSizeZ(), [&](size_t row) {
+				const int y = (int) (row % sizeY);
+				const int z = (int) (row / sizeY);
+				for (int x = 0; x < sizeX; x++) {
+					this->grid.set(x, y, z, (float) tree.getSignedDistance(this->getPosition(x, y, z)));
+				}
+			});
+			return true;
+		}
+
+		//----------
+		// Position of a sample in mesh units
+		glm::tvec3<double> getPosition(int x, int y, int z) const {
+			return this->origin + glm::tvec3<double>(x, y, z) * this->voxelSize;
+		}
+
+		//----------
+		// Interpolated signed distance at a position in mesh units. Works with Jets.
+		template<typename T>
+		T getDistance(const glm::tvec3<T> & position) const {
+			const T x = (position.x - this->origin.x) / this->voxelSize;
+			const T y = (position.y - this->origin.y) / this->voxelSize;
+			const T z = (position.z - this->origin.z) / this->voxelSize;
+			T distance;
+			this->interpolator.Evaluate(x, y, z, &distance);
+			return distance;
+		}
+
+		//----------
+		const GridType & getGrid() const {
+			return this->grid;
+		}
+
+		//----------
+		const glm::tvec3<double> & getOrigin() const {
+			return this->origin;
+		}
+
+		//----------
+		double getVoxelSize() const {
+			return this->voxelSize;
+		}
+
+	protected:
+		struct Triangle {
+			glm::tvec3<double> vertices[3];
+		};
+
+		//----------
+		// Bounding volume hierarchy over the triangles, split at the median centroid
+		// on the widest axis as KdTree. Nodes live in one flat array with siblings
+		// next to each other. The nearest triangle search is best first with boxes
+		// farther than the best distance so far skipped. The winding number follows
+		// Barill et al., Fast Winding Numbers for Soups and Clouds (2018): a node far
+		// from the query (beyond Beta times its radius) counts as one dipole, its
+		// area weighted normal at its area weighted centroid, and only the nodes
+		// near the query are summed triangle by triangle.
+		class TriangleTree {
+		public:
+			//----------
+			void build(std::vector<Triangle> && triangles) {
+				this->triangles = std::move(triangles);
+				this->nodes.clear();
+				if (this->triangles.empty()) {
+					return;
+				}
+				this->nodes.reserve(2 * (this->triangles.size() / LeafSize + 1));
+				this->nodes.push_back(Node());
+				this->buildNode(0, 0, (uint32_t) this->triangles.size());
+			}
+
+			//----------
+			// Bounds of all the triangles, unchanged if there are none
+			void getBounds(glm::tvec3<double> & minimum, glm::tvec3<double> & maximum) const {
+				if (!this->nodes.empty()) {
+					minimum = this->nodes.front().minimum;
+					maximum = this->nodes.front().maximum;
+				}
+			}
+
+			//----------
+			double getSignedDistance(const glm::tvec3<double> & position) const {
+				if (this->nodes.empty()) {
+					return std::numeric_limits<double>::max();
+				}
+				const double distance = std::sqrt(this->getDistanceSquared(position));
+				return std::abs(this->getWindingNumber(position)) > 0.5 ? -distance : distance;
+			}
+
+		protected:
+			struct Node {
+				glm::tvec3<double> minimum;
+				glm::tvec3<double> maximum;
+				glm::tvec3<double> center; // area weighted centroid of the triangles
+				glm::tvec3<double> areaNormal; // sum of the normals scaled by the triangle areas
+				double radius = 0.0; // around center, holding every vertex
+				uint32_t first = 0; // leaf : first triangle. inner : index of left child, right child follows
+				uint32_t count = 0; // leaf : number of triangles, 0 for inner nodes
+			};
+
+			struct StackEntry {
+				uint32_t node;
+				double distance2; // lower bound of the distance to anything in the node
+			};
+
+			// each level pushes 2 and pops 1, so this covers trees far deeper than 2^32 triangles need
+			static const int MaxDepth = 128;
+			static const uint32_t LeafSize = 4;
+
+			// a dipole stands in for a node from this many radii away
+			static constexpr double Beta = 2.0;
+
+			//----------
+			void buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end) {
+				Node node;
+				node.minimum = glm::tvec3<double>(std::numeric_limits<double>::max());
+				node.maximum = glm::tvec3<double>(-std::numeric_limits<double>::max());
+				node.areaNormal = glm::tvec3<double>(0.0);
+				glm::tvec3<double> centroidMinimum(std::numeric_limits<double>::max());
+				glm::tvec3<double> centroidMaximum(-std::numeric_limits<double>::max());
+				glm::tvec3<double> weightedCentroid(0.0);
+				double area = 0.0;
+				for (uint32_t i = begin; i < end; i++) {
+					const auto & vertices = this->triangles[i].vertices;
+					for (const auto & vertex : vertices) {
+						node.minimum = glm::min(node.minimum, vertex);
+						node.maximum = glm::max(node.maximum, vertex);
+					}
+					const auto centroid = getCentroid(this->triangles[i]);
+					centroidMinimum = glm::min(centroidMinimum, centroid);
+					centroidMaximum = glm::max(centroidMaximum, centroid);
+
+					const auto areaNormal = glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]) * 0.5;
+					const double triangleArea = glm::length(areaNormal);
+					node.areaNormal = node.areaNormal + areaNormal;
+					weightedCentroid = weightedCentroid + centroid * triangleArea;
+					area += triangleArea;
+				}
+				node.center = area > 0.0
+					? weightedCentroid / area
+					: (node.minimum + node.maximum) * 0.5;
+				for (uint32_t i = begin; i < end; i++) {
+					for (const auto & vertex : this->triangles[i].vertices) {
+						node.radius = std::max(node.radius, glm::length(vertex - node.center));
+					}
+				}
+
+				const uint32_t count = end - begin;
+				if (count <= LeafSize) {
+					node.first = begin;
+					node.count = count;
+					this->nodes[nodeIndex] = node;
+					return;
+				}
+
+				int axis = 0;
+				for (int i = 1; i < 3; i++) {
+					if (centroidMaximum[i] - centroidMinimum[i] > centroidMaximum[axis] - centroidMinimum[axis]) {
+						axis = i;
+					}
+				}
+
+				const uint32_t middle = begin + count / 2;
+				std::nth_element(this->triangles.begin() + begin
+					, this->triangles.begin() + middle
+					, this->triangles.begin() + end
+					, [axis](const Triangle & a, const Triangle & b) {
+					return getCentroid(a)[axis] < getCentroid(b)[axis];
+				});
+
+				const uint32_t leftChild = (uint32_t) this->nodes.size();
+				this->nodes.push_back(Node());
+				this->nodes.push_back(Node());
+				node.first = leftChild;
+				this->nodes[nodeIndex] = node;
+
+				this->buildNode(leftChild, begin, middle);
+				this->buildNode(leftChild + 1, middle, end);
+			}
+
+			//----------
+			double getDistanceSquared(const glm::tvec3<double> & position) const {
+				double best = std::numeric_limits<double>::max();
+
+				StackEntry stack[MaxDepth];
+				int stackSize = 0;
+				stack[stackSize++] = { 0, 0.0 };
+
+				while (stackSize > 0) {
+					const auto entry = stack[--stackSize];
+					if (entry.distance2 >= best) {
+						continue;
+					}
+
+					const auto & node = this->nodes[entry.node];
+					if (node.count > 0) {
+						const auto end = node.first + node.count;
+						for (uint32_t i = node.first; i < end; i++) {
+							const auto offset = getClosestPoint(this->triangles[i], position) - position;
+							best = std::min(best, glm::dot(offset, offset));
+						}
+					}
+					else {
+						const double left = getBoxDistanceSquared(this->nodes[node.first], position);
+						const double right = getBoxDistanceSquared(this->nodes[node.first + 1], position);
+
+						// far side first so the near side is popped next
+						if (left < right) {
+							stack[stackSize++] = { node.first + 1, right };
+							stack[stackSize++] = { node.first, left };
+						}
+						else {
+							stack[stackSize++] = { node.first, left };
+							stack[stackSize++] = { node.first + 1, right };
+						}
+					}
+				}
+				return best;
+			}
+
+			//----------
+			double getWindingNumber(const glm::tvec3<double> & position) const {
+				double solidAngle = 0.0;
+
+				uint32_t stack[MaxDepth];
+				int stackSize = 0;
+				stack[stackSize++] = 0;
+
+				while (stackSize > 0) {
+					const auto & node = this->nodes[stack[--stackSize]];
+					if (node.count > 0) {
+						const auto end = node.first + node.count;
+						for (uint32_t i = node.first; i < end; i++) {
+							solidAngle += getSolidAngle(this->triangles[i], position);
+						}
+						continue;
+					}
+
+					const auto offset = node.center - position;
+					const double distance2 = glm::dot(offset, offset);
+					if (distance2 > Beta * Beta * node.radius * node.radius) {
+						solidAngle += glm::dot(offset, node.areaNormal) / (distance2 * std::sqrt(distance2));
+					}
+					else {
+						stack[stackSize++] = node.first;
+						stack[stackSize++] = node.first + 1;
+					}
+				}
+				return solidAngle / (4.0 * M_PI);
+			}
+
+			//----------
+			static glm::tvec3<double> getCentroid(const Triangle & triangle) {
+				return (triangle.vertices[0] + triangle.vertices[1] + triangle.vertices[2]) / 3.0;
+			}
+
+			//----------
+			static double getBoxDistanceSquared(const Node & node, const glm::tvec3<double> & position) {
+				const auto offset = glm::max(glm::max(node.minimum - position, position - node.maximum)
+					, glm::tvec3<double>(0.0));
+				return glm::dot(offset, offset);
+			}
+
+			//----------
+			// Van Oosterom and Strackee
+			static double getSolidAngle(const Triangle & triangle, const glm::tvec3<double> & position) {
+				const auto a = triangle.vertices[0] - position;
+				const auto b = triangle.vertices[1] - position;
+				const auto c = triangle.vertices[2] - position;
+				const double la = glm::length(a);
+				const double lb = glm::length(b);
+				const double lc = glm::length(c);
+				const double numerator = glm::dot(a, glm::cross(b, c));
+				const double denominator = la * lb * lc + glm::dot(a, b) * lc + glm::dot(a, c) * lb + glm::dot(b, c) * la;
+				return 2.0 * std::atan2(numerator, denominator);
+			}
+
+			//----------
+			// Closest point on a triangle, from Ericson's Real-Time Collision Detection
+			static glm::tvec3<double> getClosestPoint(const Triangle & triangle, const glm::tvec3<double> & p) {
+				const auto & a = triangle.vertices[0];
+				const auto & b = triangle.vertices[1];
+				const auto & c = triangle.vertices[2];
+				const auto ab = b - a;
+				const auto ac = c - a;
+
+				const auto ap = p - a;
+				const double d1 = glm::dot(ab, ap);
+				const double d2 = glm::dot(ac, ap);
+				if (d1 <= 0.0 && d2 <= 0.0) {
+					return a;
+				}
+
+				const auto bp = p - b;
+				const double d3 = glm::dot(ab, bp);
+				const double d4 = glm::dot(ac, bp);
+				if (d3 >= 0.0 && d4 <= d3) {
+					return b;
+				}
+
+				const double vc = d1 * d4 - d3 * d2;
+				if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+					return a + ab * (d1 / (d1 - d3));
+				}
+
+				const auto cp = p - c;
+				const double d5 = glm::dot(ab, cp);
+				const double d6 = glm::dot(ac, cp);
+				if (d6 >= 0.0 && d5 <= d6) {
+					return c;
+				}
+
+				const double vb = d5 * d2 - d1 * d6;
+				if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+					return a + ac * (d2 / (d2 - d6));
+				}
+
+				const double va = d3 * d6 - d5 * d4;
+				if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+					return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+				}
+
+				const double denominator = 1.0 / (va + vb + vc);
+				return a + ab * (vb * denominator) + ac * (vc * denominator);
+			}
+
+			std::vector<Node> nodes;
+			std::vector<Triangle> triangles; // ordered by leaf
+		};
+
+		//----------
+		// OF_PRIMITIVE_TRIANGLES, indexed or not
+		static std::vector<Triangle> getTriangles(const ofMesh & mesh) {
+			std::vector<Triangle> triangles;
+			const auto & vertices = mesh.getVertices();
+			if (mesh.hasIndices()) {
+				const auto & indices = mesh.getIndices();
+				for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+					Triangle triangle;
+					for (int j = 0; j < 3; j++) {
+						triangle.vertices[j] = glm::tvec3<double>(vertices[indices[i + j]]);
+					}
+					triangles.push_back(triangle);
+				}
+			}
+			else {
+				for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+					Triangle triangle;
+					for (int j = 0; j < 3; j++) {
+						triangle.vertices[j] = glm::tvec3<double>(vertices[i + j]);
+					}
+					triangles.push_back(triangle);
+				}
+			}
+			return triangles;
+		}
+
+		GridType grid;
+		TriCubicInterpolator<GridType> interpolator;
+		glm::tvec3<double> origin;
+		double voxelSize = 1.0;
+	};
+
+	//----------
+	// Signed distance of a scanned point, moved into the model's frame by the 6
+	// transform parameters (as RigidBodyTransformError), from the model surface.
+	// With one residual block per scanned point the solve aligns the scan to the
+	// model without any correspondence search.
+	struct SignedDistanceTransformError {
+		SignedDistanceTransformError(const SignedDistanceField & field, const glm::tvec3<double> & scannedPoint)
+			: field(field)
+			, scannedPoint(scannedPoint) {}
+
+		template <typename T>
+		bool operator()(const T * const transformParameters
+			, T * residuals) const {
+			glm::tvec3<T> translation(transformParameters[0], transformParameters[1], transformParameters[2]);
+			glm::tvec3<T> rotationVector(transformParameters[3], transformParameters[4], transformParameters[5]);
+
+			auto transform = VectorMath::createAffineTransform(translation, rotationVector);
+			residuals[0] = this->field.getDistance(transform.transformPoint(this->scannedPoint));
+			return true;
+		}
+
+		static ceres::CostFunction * Create(const SignedDistanceField & field, const glm::tvec3<double> & scannedPoint) {
+			return (new ceres::AutoDiffCostFunction<SignedDistanceTransformError, 1, 6>(
+				new SignedDistanceTransformError(field, scannedPoint)));
+		}
+
+		const SignedDistanceField & field;
+		glm::tvec3<double> scannedPoint;
+	};
+}
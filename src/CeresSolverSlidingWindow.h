@@ -0,0 +1,285 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverCostFunctions.h"
+
+#include <ceres/normal_prior.h>
+#include <Eigen/Dense>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Pose change between consecutive frames, weighted per parameter. Expresses a
+	// random walk motion model: the pose is expected to stay where it was, with
+	// the given standard deviation per frame.
+	struct PoseMotionPriorError {
+		PoseMotionPriorError(const double * weights) {
+			std::copy(weights, weights + 6, this->weights);
+		}
+
+		template <typename T>
+		bool operator()(const T * const previousParameters
+			, const T * const parameters
+			, T * residuals) const {
+			for (int i = 0; i < 6; i++) {
+				residuals[i] = (parameters[i] - previousParameters[i]) * this->weights[i];
+			}
+			return true;
+		}
+
+		static ceres::CostFunction * Create(const double * weights) {
+			return (new ceres::AutoDiffCostFunction<PoseMotionPriorError, 6, 6, 6>(
+				new PoseMotionPriorError(weights)));
+		}
+
+		double weights[6];
+	};
+
+	//----------
+	// Fixed lag smoother for one rigid body. The last windowSize frames each keep
+	// a 6 parameter pose (as RigidBodyTransformError) tied together by
+	// PoseMotionPriorError, and every frame is solved over the whole window.
+	// When the window is full the oldest frame is marginalized: its measurements,
+	// motion prior and any earlier prior are linearized at the current estimate,
+	// the frame is eliminated with a Schur complement, and the result becomes a
+	// ceres::NormalPrior on the new oldest frame. So the cost per frame depends on
+	// the window size only, however long the session runs.
+	class SlidingWindowSmoother {
+	public:
+		struct Settings {
+			size_t windowSize = 10;
+
+			// measurement noise of the point pairs, in point units
+			double measurementSigma = 0.001;
+
+			// expected pose change per frame
+			double translationSigma = 0.01; // point units
+			double rotationSigma = 0.02; // radians
+
+			ceres::Solver::Options solverOptions = defaultSolverOptions();
+		};
+
+		//----------
+		static ceres::Solver::Options defaultSolverOptions() {
+			ceres::Solver::Options options;
+			// few small blocks in a chain, so the dense normal equations are cheapest
+			options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+			options.max_num_iterations = 10;
+			options.minimizer_progress_to_stdout = false;
+			options.logging_type = ceres::SILENT;
+			return options;
+		}
+
+		//----------
+		SlidingWindowSmoother()
+			: SlidingWindowSmoother(Settings()) {
+		}
+
+		//----------
+		SlidingWindowSmoother(const Settings & settings)
+			: settings(settings) {
+			for (int i = 0; i < 3; i++) {
+				// residuals are in units of measurementSigma
+				this->motionWeights[i] = this->settings.measurementSigma / this->settings.translationSigma;
+				this->motionWeights[i + 3] = this->settings.measurementSigma / this->settings.rotationSigma;
+			}
+		}
+
+		//----------
+		void reset() {
+			this->frames.clear();
+			this->hasPrior = false;
+			this->frameCount = 0;
+		}
+
+		//----------
+		// Adds a frame starting from the latest pose and solves the window.
+		// Frames without point pairs are carried by the motion prior alone.
+		ceres::Solver::Summary addFrame(const std::vector<glm::vec3> & untransformedPoints
+			, const std::vector<glm::vec3> & transformedPoints) {
+			Frame frame;
+			if (!this->frames.empty()) {
+				std::copy(this->frames.back().parameters, this->frames.back().parameters + 6, frame.parameters);
+			}
+			frame.untransformedPoints = untransformedPoints;
+			frame.transformedPoints = transformedPoints;
+			this->frames.push_back(frame);
+			this->frameCount++;
+
+			while (this->frames.size() > std::max((size_t) 2, this->settings.windowSize)) {
+				this->marginalizeOldestFrame();
+			}
+
+			return this->solve();
+		}
+
+		//----------
+		// 0 = latest frame
+		glm::mat4 getTransform(size_t framesAgo = 0) const {
+			if (framesAgo >= this->frames.size()) {
+				return glm::mat4(1.0f);
+			}
+			const auto & parameters = this->frames[this->frames.size() - 1 - framesAgo].parameters;
+			glm::tvec3<double> translation(parameters[0], parameters[1], parameters[2]);
+			glm::tvec3<double> rotationVector(parameters[3], parameters[4], parameters[5]);
+			return glm::mat4(VectorMath::createTransform(translation, rotationVector));
+		}
+
+		//----------
+		const double * getParameters(size_t framesAgo = 0) const {
+			return this->frames[this->frames.size() - 1 - framesAgo].parameters;
+		}
+
+		//----------
+		size_t getWindowFrameCount() const {
+			return this->frames.size();
+		}
+
+		//----------
+		// all frames added since the last reset
+		size_t getFrameCount() const {
+			return this->frameCount;
+		}
+
+	protected:
+		struct Frame {
+			double parameters[6] = { 0, 0, 0, 0, 0, 0 };
+			std::vector<glm::vec3> untransformedPoints;
+			std::vector<glm::vec3> transformedPoints;
+		};
+
+		//----------
+		ceres::Solver::Summary solve() {
+			ceres::Problem problem;
+
+			for (size_t i = 0; i < this->frames.size(); i++) {
+				auto & frame = this->frames[i];
+				problem.AddParameterBlock(frame.parameters, 6);
+				this->addMeasurements(problem, frame);
+				if (i > 0) {
+					problem.AddResidualBlock(PoseMotionPriorError::Create(this->motionWeights)
+						, NULL
+						, this->frames[i - 1].parameters
+						, frame.parameters);
+				}
+			}
+
+			if (this->hasPrior) {
+				problem.AddResidualBlock(new ceres::NormalPrior(this->priorA, this->priorB)
+					, NULL
+					, this->frames.front().parameters);
+			}
+
+			ceres::Solver::Summary summary;
+			ceres::Solve(this->settings.solverOptions, &problem, &summary);
+			return summary;
+		}
+
+		//----------
+		void addMeasurements(ceres::Problem & problem, Frame & frame) const {
+			const auto count = std::min(frame.untransformedPoints.size(), frame.transformedPoints.size());
+			for (size_t i = 0; i < count; i++) {
+				problem.AddResidualBlock(RigidBodyTransformError::Create(frame.untransformedPoints[i], frame.transformedPoints[i])
+					, NULL
+					, frame.parameters);
+			}
+		}
+
+		//----------
+		void marginalizeOldestFrame() {
+			auto & oldest = this->frames[0];
+			auto & next = this->frames[1];
+
+			// Gauss Newton system over [oldest, next] from every factor touching oldest
+			Eigen::Matrix<double, 12, 12> H = Eigen::Matrix<double, 12, 12>::Zero();
+			Eigen::Matrix<double, 12, 1> g = Eigen::Matrix<double, 12, 1>::Zero();
+
+			{
+				const double * parameterBlocks[] = { oldest.parameters };
+				Eigen::Matrix<double, 3, 6, Eigen::RowMajor> J;
+				Eigen::Matrix<double, 3, 1> r;
+				double * jacobians[] = { J.data() };
+				const auto count = std::min(oldest.untransformedPoints.size(), oldest.transformedPoints.size());
+				for (size_t i = 0; i < count; i++) {
+					ceres::AutoDiffCostFunction<RigidBodyTransformError, 3, 6> costFunction(
+						new RigidBodyTransformError(oldest.untransformedPoints[i], oldest.transformedPoints[i]));
+					costFunction.Evaluate(parameterBlocks, r.data(), jacobians);
+					H.topLeftCorner<6, 6>() += J.transpose() * J;
+					g.head<6>() += J.transpose() * r;
+				}
+			}
+
+			{
+				const double * parameterBlocks[] = { oldest.parameters, next.parameters };
+				Eigen::Matrix<double, 6, 6, Eigen::RowMajor> J0, J1;
+				Eigen::Matrix<double, 6, 1> r;
+				double * jacobians[] = { J0.data(), J1.data() };
+				std::unique_ptr<ceres::CostFunction> costFunction(PoseMotionPriorError::Create(this->motionWeights));
+				costFunction->Evaluate(parameterBlocks, r.data(), jacobians);
+				Eigen::Matrix<double, 6, 12> J;
+				J << J0, J1;
+				H += J.transpose() * J;
+				g += J.transpose() * r;
+			}
+
+			if (this->hasPrior) {
+				// r = A (x - b) is already linear
+				Eigen::Map<const Eigen::Matrix<double, 6, 1>> x(oldest.parameters);
+				const Eigen::Matrix<double, 6, 6> A = this->priorA;
+				const Eigen::Matrix<double, 6, 1> r = A * (x - this->priorB);
+				H.topLeftCorner<6, 6>() += A.transpose() * A;
+				g.head<6>() += A.transpose() * r;
+			}
+
+			// eliminate oldest
+			const Eigen::Matrix<double, 6, 6> H00 = H.topLeftCorner<6, 6>();
+			const Eigen::Matrix<double, 6, 6> H01 = H.topRightCorner<6, 6>();
+			const auto H00Inverse = pseudoInverse(H00);
+			const Eigen::Matrix<double, 6, 6> marginalH = H.bottomRightCorner<6, 6>() - H01.transpose() * H00Inverse * H01;
+			const Eigen::Matrix<double, 6, 1> marginalG = g.tail<6>() - H01.transpose() * H00Inverse * g.head<6>();
+
+			// 0.5 |A (x - b)|^2 with A^T A = marginalH and its minimum at the Gauss Newton step
+			Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 6, 6>> solver(marginalH);
+			const auto & eigenvalues = solver.eigenvalues();
+			const double threshold = std::max(eigenvalues.maxCoeff(), 0.0) * 1e-12;
+			Eigen::Matrix<double, 6, 1> sqrtEigenvalues, inverseEigenvalues;
+			for (int i = 0; i < 6; i++) {
+				const bool valid = eigenvalues(i) > threshold;
+				sqrtEigenvalues(i) = valid ? sqrt(eigenvalues(i)) : 0.0;
+				inverseEigenvalues(i) = valid ? 1.0 / eigenvalues(i) : 0.0;
+			}
+
+			Eigen::Map<const Eigen::Matrix<double, 6, 1>> nextParameters(next.parameters);
+			this->priorA = sqrtEigenvalues.asDiagonal() * solver.eigenvectors().transpose();
+			this->priorB = nextParameters - solver.eigenvectors() * inverseEigenvalues.asDiagonal() * solver.eigenvectors().transpose() * marginalG;
+			this->hasPrior = true;
+
+			this->frames.pop_front();
+		}
+
+		//----------
+		static Eigen::Matrix<double, 6, 6> pseudoInverse(const Eigen::Matrix<double, 6, 6> & matrix) {
+			Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 6, 6>> solver(matrix);
+			const auto & eigenvalues = solver.eigenvalues();
+			const double threshold = std::max(eigenvalues.maxCoeff(), 0.0) * 1e-12;
+			Eigen::Matrix<double, 6, 1> inverseEigenvalues;
+			for (int i = 0; i < 6; i++) {
+				inverseEigenvalues(i) = eigenvalues(i) > threshold ? 1.0 / eigenvalues(i) : 0.0;
+			}
+			return solver.eigenvectors() * inverseEigenvalues.asDiagonal() * solver.eigenvectors().transpose();
+		}
+
+		Settings settings;
+		double motionWeights[6];
+
+		std::deque<Frame> frames;
+		size_t frameCount = 0;
+
+		bool hasPrior = false;
+		ceres::Matrix priorA; // on frames.front()
+		ceres::Vector priorB;
+	};
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverCostFunctions.h"
+#include "CeresSolverMappedFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Binary record of a rigid body solve (correspondences, initial parameters and
+	// Solver::Options) for reproducing bad or slow solves offline.
+	//
+	// Layout, little endian, every section 8 byte aligned:
+	//	Header
+	//	Correspondence[correspondenceCount] at header.correspondenceOffset
+	//
+	// Readers accept any file whose major version matches and use the offsets in
+	// the header, so minor versions may append fields to the header.
+	namespace Snapshot {
+		static const char Magic[8] = { 'o', 'f', 'x', 'C', 'S', 'n', 'a', 'p' };
+		static const uint16_t VersionMajor = 1;
+		static const uint16_t VersionMinor = 0;
+
+		//----------
+		struct SolverOptions {
+			int32_t minimizerType;
+			int32_t trustRegionStrategyType;
+			int32_t linearSolverType;
+			int32_t preconditionerType;
+			int32_t denseLinearAlgebraLibraryType;
+			int32_t sparseLinearAlgebraLibraryType;
+			int32_t maxNumIterations;
+			int32_t numThreads;
+			int32_t useNonmonotonicSteps;
+			int32_t maxConsecutiveNonmonotonicSteps;
+			int32_t useExplicitSchurComplement;
+			int32_t jacobiScaling;
+			double maxSolverTimeInSeconds;
+			double functionTolerance;
+			double gradientTolerance;
+			double parameterTolerance;
+			double initialTrustRegionRadius;
+			double maxTrustRegionRadius;
+			double minRelativeDecrease;
+
+			//----------
+			static SolverOptions from(const ceres::Solver::Options & options) {
+				SolverOptions record;
+				std::memset(&record, 0, sizeof(record));
+				record.minimizerType = options.minimizer_type;
+				record.trustRegionStrategyType = options.trust_region_strategy_type;
+				record.linearSolverType = options.linear_solver_type;
+				record.preconditionerType = options.preconditioner_type;
+				record.denseLinearAlgebraLibraryType = options.dense_linear_algebra_library_type;
+				record.sparseLinearAlgebraLibraryType = options.sparse_linear_algebra_library_type;
+				record.maxNumIterations = options.max_num_iterations;
+				record.numThreads = options.num_threads;
+				record.useNonmonotonicSteps = options.use_nonmonotonic_steps;
+				record.maxConsecutiveNonmonotonicSteps = options.max_consecutive_nonmonotonic_steps;
+				record.useExplicitSchurComplement = options.use_explicit_schur_complement;
+				record.jacobiScaling = options.jacobi_scaling;
+				record.maxSolverTimeInSeconds = options.max_solver_time_in_seconds;
+				record.functionTolerance = options.function_tolerance;
+				record.gradientTolerance = options.gradient_tolerance;
+				record.parameterTolerance = options.parameter_tolerance;
+				record.initialTrustRegionRadius = options.initial_trust_region_radius;
+				record.maxTrustRegionRadius = options.max_trust_region_radius;
+				record.minRelativeDecrease = options.min_relative_decrease;
+				return record;
+			}
+
+			//----------
+			ceres::Solver::Options to() const {
+				ceres::Solver::Options options;
+				options.minimizer_type = (ceres::MinimizerType) this->minimizerType;
+				options.trust_region_strategy_type = (ceres::TrustRegionStrategyType) this->trustRegionStrategyType;
+				options.linear_solver_type = (ceres::LinearSolverType) this->linearSolverType;
+				options.preconditioner_type = (ceres::PreconditionerType) this->preconditionerType;
+				options.dense_linear_algebra_library_type = (ceres::DenseLinearAlgebraLibraryType) this->denseLinearAlgebraLibraryType;
+				options.sparse_linear_algebra_library_type = (ceres::SparseLinearAlgebraLibraryType) this->sparseLinearAlgebraLibraryType;
+				options.max_num_iterations = this->maxNumIterations;
+				options.num_threads = this->numThreads;
+				options.use_nonmonotonic_steps = this->useNonmonotonicSteps != 0;
+				options.max_consecutive_nonmonotonic_steps = this->maxConsecutiveNonmonotonicSteps;
+				options.use_explicit_schur_complement = this->useExplicitSchurComplement != 0;
+				options.jacobi_scaling = this->jacobiScaling != 0;
+				options.max_solver_time_in_seconds = this->maxSolverTimeInSeconds;
+				options.function_tolerance = this->functionTolerance;
+				options.gradient_tolerance = this->gradientTolerance;
+				options.parameter_tolerance = this->parameterTolerance;
+				options.initial_trust_region_radius = this->initialTrustRegionRadius;
+				options.max_trust_region_radius = this->maxTrustRegionRadius;
+				options.min_relative_decrease = this->minRelativeDecrease;
+				options.logging_type = ceres::SILENT;
+				return options;
+			}
+		};
+
+		//----------
+		struct Header {
+			char magic[8];
+			uint16_t versionMajor;
+			uint16_t versionMinor;
+			uint32_t headerSize;
+			uint64_t correspondenceCount;
+			uint64_t correspondenceOffset;
+			double initialParameters[6];
+			SolverOptions solverOptions;
+		};
+
+		//----------
+		struct Correspondence {
+			float untransformed[3];
+			float transformed[3];
+		};
+
+		static_assert(sizeof(Header) % 8 == 0, "snapshot header must stay 8 byte aligned");
+		static_assert(sizeof(Correspondence) == 24, "snapshot correspondences must be tightly packed");
+
+		//----------
+		inline size_t alignTo8(size_t offset) {
+			return (offset + 7) & ~(size_t) 7;
+		}
+
+		//----------
+		inline bool save(const std::string & path
+			, const std::vector<glm::vec3> & untransformedPoints
+			, const std::vector<glm::vec3> & transformedPoints
+			, const double * initialParameters
+			, const ceres::Solver::Options & options) {
+			if (untransformedPoints.size() != transformedPoints.size()) {
+				return false;
+			}
+
+			Header header;
+			std::memset(&header, 0, sizeof(header));
+			std::memcpy(header.magic, Magic, sizeof(Magic));
+			header.versionMajor = VersionMajor;
+			header.versionMinor = VersionMinor;
+			header.headerSize = sizeof(Header);
+			header.correspondenceCount = untransformedPoints.size();
+			header.correspondenceOffset = alignTo8(sizeof(Header));
+			std::copy(initialParameters, initialParameters + 6, header.initialParameters);
+			header.solverOptions = SolverOptions::from(options);
+
+			std::ofstream file(path, std::ios::binary);
+			if (!file) {
+				return false;
+			}
+			file.write((const char *) &header, sizeof(header));
+			const char padding[8] = { 0 };
+			file.write(padding, header.correspondenceOffset - sizeof(header));
+
+			// write through a fixed size buffer to avoid a second full copy of the data
+			std::vector<Correspondence> buffer;
+			buffer.reserve(4096);
+			for (size_t i = 0; i < untransformedPoints.size(); i++) {
+				Correspondence correspondence;
+				for (int j = 0; j < 3; j++) {
+					correspondence.untransformed[j] = untransformedPoints[i][j];
+					correspondence.transformed[j] = transformedPoints[i][j];
+				}
+				buffer.push_back(correspondence);
+				if (buffer.size() == buffer.capacity() || i + 1 == untransformedPoints.size()) {
+					file.write((const char *) buffer.data(), buffer.size() * sizeof(Correspondence));
+					buffer.clear();
+				}
+			}
+			return (bool) file;
+		}
+
+		//----------
+		// Maps the file and points straight into it, nothing is parsed or copied.
+		class Reader {
+		public:
+			//----------
+			bool open(const std::string & path) {
+				this->header = nullptr;
+				if (!this->file.open(path)) {
+					return false;
+				}
+				const size_t size = this->file.getSize();
+				if (size < sizeof(Header)) {
+					this->file.close();
+					return false;
+				}
+
+				// the header may be corrupt, so the sizes are checked without overflowing
+				auto header = (const Header *) this->file.getData();
+				if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0
+					|| header->versionMajor != VersionMajor
+					|| header->headerSize < sizeof(Header)
+					|| header->correspondenceOffset % 8 != 0
+					|| header->correspondenceOffset > size
+					|| header->correspondenceCount > (size - header->correspondenceOffset) / sizeof(Correspondence)) {
+					this->file.close();
+					return false;
+				}
+
+				this->header = header;
+				return true;
+			}
+
+			//----------
+			bool isOpen() const {
+				return this->header != nullptr;
+			}
+
+			//----------
+			size_t getCorrespondenceCount() const {
+				return (size_t) this->header->correspondenceCount;
+			}
+
+			//----------
+			const Correspondence * getCorrespondences() const {
+				return (const Correspondence *) (this->file.getData() + this->header->correspondenceOffset);
+			}
+
+			//----------
+			const double * getInitialParameters() const {
+				return this->header->initialParameters;
+			}
+
+			//----------
+			ceres::Solver::Options getSolverOptions() const {
+				return this->header->solverOptions.to();
+			}
+
+			//----------
+			// parameters receives the initial parameters and is the problem's parameter block
+			void buildProblem(ceres::Problem & problem, double * parameters) const {
+				std::copy(this->getInitialParameters(), this->getInitialParameters() + 6, parameters);
+
+				const auto correspondences = this->getCorrespondences();
+				const auto count = this->getCorrespondenceCount();
+				for (size_t i = 0; i < count; i++) {
+					const auto & correspondence = correspondences[i];
+					problem.AddResidualBlock(RigidBodyTransformError::Create(
+						glm::tvec3<double>(correspondence.untransformed[0], correspondence.untransformed[1], correspondence.untransformed[2])
+						, glm::tvec3<double>(correspondence.transformed[0], correspondence.transformed[1], correspondence.transformed[2]))
+						, NULL
+						, parameters);
+				}
+			}
+
+		protected:
+			MappedFile file;
+			const Header * header = nullptr;
+		};
+
+		//----------
+		// Solves like the example's solve() and writes a snapshot of the inputs
+		// whenever the solve is slower than a threshold or does not converge.
+		class SlowSolveCapture {
+		public:
+			//----------
+			// snapshots are named <pathPrefix><index>.snapshot
+			SlowSolveCapture(const std::string & pathPrefix, double thresholdSeconds)
+				: pathPrefix(pathPrefix)
+				, thresholdSeconds(thresholdSeconds) {}
+
+			//----------
+			ceres::Solver::Summary solve(const ceres::Solver::Options & options
+				, const std::vector<glm::vec3> & untransformedPoints
+				, const std::vector<glm::vec3> & transformedPoints
+				, double * parameters) {
+				double initialParameters[6];
+				std::copy(parameters, parameters + 6, initialParameters);
+
+				ceres::Problem problem;
+				for (size_t i = 0; i < untransformedPoints.size(); i++) {
+					problem.AddResidualBlock(RigidBodyTransformError::Create(untransformedPoints[i], transformedPoints[i])
+						, NULL
+						, parameters);
+				}
+
+				ceres::Solver::Summary summary;
+				ceres::Solve(options, &problem, &summary);
+
+				if (summary.total_time_in_seconds > this->thresholdSeconds
+					|| summary.termination_type != ceres::CONVERGENCE) {
+					std::stringstream path;
+					path << this->pathPrefix << this->captureCount << ".snapshot";
+					if (save(path.str(), untransformedPoints, transformedPoints, initialParameters, options)) {
+						this->lastCapturePath = path.str();
+						this->captureCount++;
+					}
+				}
+
+				return summary;
+			}
+
+			//----------
+			size_t getCaptureCount() const {
+				return this->captureCount;
+			}
+
+			//----------
+			const std::string & getLastCapturePath() const {
+				return this->lastCapturePath;
+			}
+
+		protected:
+			std::string pathPrefix;
+			double thresholdSeconds;
+			size_t captureCount = 0;
+			std::string lastCapturePath;
+		};
+	}
+}
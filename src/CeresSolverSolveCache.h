@@ -0,0 +1,514 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+#include "CeresSolverCostFunctions.h"
+#include "CeresSolverSnapshot.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Fast non cryptographic 64 bit hash of the inputs of a solve (the MurmurHash3
+	// mixing steps over 8 byte words), used as the key of SolveCache. Inputs are
+	// hashed as raw bytes, so they must be added in the same order every time.
+	class Fingerprint {
+	public:
+		//----------
+		Fingerprint & add(const void * data, size_t size) {
+			auto bytes = (const uint8_t *) data;
+			this->length += size;
+			for (; size >= 8; size -= 8, bytes += 8) {
+				uint64_t word;
+				std::memcpy(&word, bytes, 8);
+				this->mix(word);
+			}
+			if (size > 0) {
+				uint64_t word = 0;
+				std::memcpy(&word, bytes, size);
+				this->mix(word ^ ((uint64_t) size << 56));
+			}
+			return *this;
+		}
+
+		//----------
+		template<typename T>
+		Fingerprint & add(const T & value) {
+			static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be hashed as bytes");
+			return this->add(&value, sizeof(T));
+		}
+
+		//----------
+		template<typename T>
+		Fingerprint & add(const std::vector<T> & values) {
+			static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be hashed as bytes");
+			this->add((uint64_t) values.size());
+			return this->add(values.data(), values.size() * sizeof(T));
+		}
+
+		//----------
+		uint64_t get() const {
+			// MurmurHash3 finalizer, so every input bit affects every output bit
+			uint64_t hash = this->state ^ this->length;
+			hash ^= hash >> 33;
+			hash *= 0xff51afd7ed558ccdULL;
+			hash ^= hash >> 33;
+			hash *= 0xc4ceb9fe1a85ec53ULL;
+			hash ^= hash >> 33;
+			return hash;
+		}
+
+	protected:
+		//----------
+		static uint64_t rotateLeft(uint64_t value, int bits) {
+			return (value << bits) | (value >> (64 - bits));
+		}
+
+		//----------
+		void mix(uint64_t word) {
+			word *= 0x87c37b91114253d5ULL;
+			word = rotateLeft(word, 31);
+			word *= 0x4cf5ad432745937fULL;
+			this->state ^= word;
+			this->state = rotateLeft(this->state, 27) * 5 + 0x52dce729;
+		}
+
+		uint64_t state = 0x9e3779b97f4a7c15ULL;
+		uint64_t length = 0;
+	};
+
+	//----------
+	// Memoizes solves by a fingerprint of their data, initial parameters and
+	// solver options, returning the stored parameters and Summary when nothing
+	// changed (e.g. re-solving the same calibration at every startup). Only
+	// usable solutions are stored. Once open() is called every new entry is
+	// appended to the cache file, so the next run starts with all of them.
+	//
+	// File layout, little endian, every section 8 byte aligned:
+	//	Header
+	//	Entry, parameters (double[parameterCount]), message (char[messageSize]), padding
+	//	...
+	//
+	// Every entry carries a checksum of itself, its parameters and its message.
+	// Loading stops at the first entry which is truncated or fails its checksum
+	// (e.g. from a crash while appending), and open() rewrites such a file so
+	// new entries are not appended after the damage. A later entry with the same
+	// key replaces an earlier one. The options are
+	// keyed through Snapshot::SolverOptions, so options which a snapshot does not
+	// record (e.g. callbacks or orderings) do not change the key. Summary::iterations
+	// is not stored.
+	class SolveCache {
+	public:
+		// adds the residual blocks to the problem, acting on the given parameters
+		typedef std::function<void(ceres::Problem & problem, double * parameters)> BuildProblem;
+
+		static const uint16_t VersionMajor = 2;
+		static const uint16_t VersionMinor = 0;
+
+		//----------
+		struct Header {
+			char magic[8];
+			uint16_t versionMajor;
+			uint16_t versionMinor;
+			uint32_t headerSize;
+		};
+
+		//----------
+		struct SummaryRecord {
+			int32_t minimizerType;
+			int32_t terminationType;
+			int32_t linearSolverTypeUsed;
+			int32_t preconditionerTypeUsed;
+			int32_t trustRegionStrategyType;
+			int32_t numSuccessfulSteps;
+			int32_t numUnsuccessfulSteps;
+			int32_t numInnerIterationSteps;
+			int32_t numLineSearchSteps;
+			int32_t numParameterBlocks;
+			int32_t numParameters;
+			int32_t numEffectiveParameters;
+			int32_t numResidualBlocks;
+			int32_t numResiduals;
+			int32_t numThreadsUsed;
+			int32_t numLinearSolves;
+			int32_t numResidualEvaluations;
+			int32_t numJacobianEvaluations;
+			double initialCost;
+			double finalCost;
+			double fixedCost;
+			double preprocessorTimeInSeconds;
+			double minimizerTimeInSeconds;
+			double postprocessorTimeInSeconds;
+			double totalTimeInSeconds;
+			double linearSolverTimeInSeconds;
+			double residualEvaluationTimeInSeconds;
+			double jacobianEvaluationTimeInSeconds;
+
+			//----------
+			static SummaryRecord from(const ceres::Solver::Summary & summary) {
+				SummaryRecord record;
+				std::memset(&record, 0, sizeof(record));
+				record.minimizerType = summary.minimizer_type;
+				record.terminationType = summary.termination_type;
+				record.linearSolverTypeUsed = summary.linear_solver_type_used;
+				record.preconditionerTypeUsed = summary.preconditioner_type_used;
+				record.trustRegionStrategyType = summary.trust_region_strategy_type;
+				record.numSuccessfulSteps = summary.num_successful_steps;
+				record.numUnsuccessfulSteps = summary.num_unsuccessful_steps;
+				record.numInnerIterationSteps = summary.num_inner_iteration_steps;
+				record.numLineSearchSteps = summary.num_line_search_steps;
+				record.numParameterBlocks = summary.num_parameter_blocks;
+				record.numParameters = summary.num_parameters;
+				record.numEffectiveParameters = summary.num_effective_parameters;
+				record.numResidualBlocks = summary.num_residual_blocks;
+				record.numResiduals = summary.num_residuals;
+				record.numThreadsUsed = summary.num_threads_used;
+				record.numLinearSolves = summary.num_linear_solves;
+				record.numResidualEvaluations = summary.num_residual_evaluations;
+				record.numJacobianEvaluations = summary.num_jacobian_evaluations;
+				record.initialCost = summary.initial_cost;
+				record.finalCost = summary.final_cost;
+				record.fixedCost = summary.fixed_cost;
+				record.preprocessorTimeInSeconds = summary.preprocessor_time_in_seconds;
+				record.minimizerTimeInSeconds = summary.minimizer_time_in_seconds;
+				record.postprocessorTimeInSeconds = summary.postprocessor_time_in_seconds;
+				record.totalTimeInSeconds = summary.total_time_in_seconds;
+				record.linearSolverTimeInSeconds = summary.linear_solver_time_in_seconds;
+				record.residualEvaluationTimeInSeconds = summary.residual_evaluation_time_in_seconds;
+				record.jacobianEvaluationTimeInSeconds = summary.jacobian_evaluation_time_in_seconds;
+				return record;
+			}
+
+			//----------
+			// The times are those of the original solve
+			ceres::Solver::Summary to(const std::string & message) const {
+				ceres::Solver::Summary summary;
+				summary.minimizer_type = (ceres::MinimizerType) this->minimizerType;
+				summary.termination_type = (ceres::TerminationType) this->terminationType;
+				summary.message = message;
+				summary.linear_solver_type_given = (ceres::LinearSolverType) this->linearSolverTypeUsed;
+				summary.linear_solver_type_used = (ceres::LinearSolverType) this->linearSolverTypeUsed;
+				summary.preconditioner_type_given = (ceres::PreconditionerType) this->preconditionerTypeUsed;
+				summary.preconditioner_type_used = (ceres::PreconditionerType) this->preconditionerTypeUsed;
+				summary.trust_region_strategy_type = (ceres::TrustRegionStrategyType) this->trustRegionStrategyType;
+				summary.num_successful_steps = this->numSuccessfulSteps;
+				summary.num_unsuccessful_steps = this->numUnsuccessfulSteps;
+				summary.num_inner_iteration_steps = this->numInnerIterationSteps;
+				summary.num_line_search_steps = this->numLineSearchSteps;
+				summary.num_parameter_blocks = this->numParameterBlocks;
+				summary.num_parameters = this->numParameters;
+				summary.num_effective_parameters = this->numEffectiveParameters;
+				summary.num_residual_blocks = this->numResidualBlocks;
+				summary.num_residuals = this->numResiduals;
+				summary.num_threads_used = this->numThreadsUsed;
+				summary.num_linear_solves = this->numLinearSolves;
+				summary.num_residual_evaluations = this->numResidualEvaluations;
+				summary.num_jacobian_evaluations = this->numJacobianEvaluations;
+				summary.initial_cost = this->initialCost;
+				summary.final_cost = this->finalCost;
+				summary.fixed_cost = this->fixedCost;
+				summary.preprocessor_time_in_seconds = this->preprocessorTimeInSeconds;
+				summary.minimizer_time_in_seconds = this->minimizerTimeInSeconds;
+				summary.postprocessor_time_in_seconds = this->postprocessorTimeInSeconds;
+				summary.total_time_in_seconds = this->totalTimeInSeconds;
+				summary.linear_solver_time_in_seconds = this->linearSolverTimeInSeconds;
+				summary.residual_evaluation_time_in_seconds = this->residualEvaluationTimeInSeconds;
+				summary.jacobian_evaluation_time_in_seconds = this->jacobianEvaluationTimeInSeconds;
+				return summary;
+			}
+		};
+
+		//----------
+		struct Entry {
+			uint64_t key;
+			uint64_t checksum; // Fingerprint of the entry (with checksum 0), parameters and message
+			uint32_t parameterCount;
+			uint32_t messageSize;
+			SummaryRecord summary;
+		};
+
+		static_assert(sizeof(Header) % 8 == 0, "cache header must stay 8 byte aligned");
+		static_assert(sizeof(Entry) % 8 == 0, "cache entries must stay 8 byte aligned");
+
+		//----------
+		SolveCache() {}
+
+		SolveCache(const SolveCache &) = delete;
+		SolveCache & operator=(const SolveCache &) = delete;
+
+		//----------
+		// Loads the entries of the file and appends new entries to it from now on.
+		// A missing, incompatible or damaged file is replaced by one holding the
+		// current entries.
+		bool open(const std::string & path) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->path.clear();
+			size_t validSize = 0;
+			size_t fileSize = 0;
+			if (!this->loadFile(path, validSize, fileSize) || validSize < fileSize) {
+				if (!this->saveFile(path)) {
+					return false;
+				}
+			}
+			this->path = path;
+			return true;
+		}
+
+		//----------
+		// Adds the entries of a cache file to those in memory
+		bool load(const std::string & path) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			size_t validSize = 0;
+			size_t fileSize = 0;
+			return this->loadFile(path, validSize, fileSize);
+		}
+
+		//----------
+		// Writes all entries, dropping those replaced by later ones
+		bool save(const std::string & path) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			return this->saveFile(path);
+		}
+
+		//----------
+		// Also empties the open file
+		void clear() {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->entries.clear();
+			if (!this->path.empty()) {
+				this->saveFile(this->path);
+			}
+		}
+
+		//----------
+		// Rigid body fit over point pairs with RigidBodyTransformError, as in the example
+		ceres::Solver::Summary solve(const ceres::Solver::Options & options
+			, const std::vector<glm::vec3> & untransformedPoints
+			, const std::vector<glm::vec3> & transformedPoints
+			, double * parameters) {
+			Fingerprint fingerprint;
+			fingerprint.add(untransformedPoints);
+			fingerprint.add(transformedPoints);
+
+			return this->solve(options
+				, fingerprint
+				, [&](ceres::Problem & problem, double * problemParameters) {
+					for (size_t i = 0; i < untransformedPoints.size(); i++) {
+						problem.AddResidualBlock(RigidBodyTransformError::Create(untransformedPoints[i], transformedPoints[i])
+							, NULL
+							, problemParameters);
+					}
+				}
+				, parameters
+				, 6);
+		}
+
+		//----------
+		// fingerprint covers the data of the problem (e.g. the correspondences),
+		// the initial parameters and the options are added to it here.
+		ceres::Solver::Summary solve(const ceres::Solver::Options & options
+			, Fingerprint fingerprint
+			, const BuildProblem & buildProblem
+			, double * parameters
+			, int parameterCount) {
+			fingerprint.add(parameters, parameterCount * sizeof(double));
+			fingerprint.add(Snapshot::SolverOptions::from(options));
+			const auto key = fingerprint.get();
+
+			ceres::Solver::Summary summary;
+			if (this->find(key, parameters, parameterCount, summary)) {
+				return summary;
+			}
+
+			ceres::Problem problem;
+			buildProblem(problem, parameters);
+			ceres::Solve(options, &problem, &summary);
+
+			if (summary.IsSolutionUsable()) {
+				this->insert(key, parameters, parameterCount, summary);
+			}
+			return summary;
+		}
+
+		//----------
+		// Writes the stored parameters and summary on a hit
+		bool find(uint64_t key
+			, double * parameters
+			, int parameterCount
+			, ceres::Solver::Summary & summary) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			auto findEntry = this->entries.find(key);
+			if (findEntry == this->entries.end()
+				|| findEntry->second.parameters.size() != (size_t) parameterCount) {
+				this->missCount++;
+				return false;
+			}
+			const auto & stored = findEntry->second;
+			std::copy(stored.parameters.begin(), stored.parameters.end(), parameters);
+			summary = stored.summary.to(stored.message);
+			this->hitCount++;
+			return true;
+		}
+
+		//----------
+		void insert(uint64_t key
+			, const double * parameters
+			, int parameterCount
+			, const ceres::Solver::Summary & summary) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			auto & stored = this->entries[key];
+			stored.parameters.assign(parameters, parameters + parameterCount);
+			stored.summary = SummaryRecord::from(summary);
+			stored.message = summary.message;
+
+			if (!this->path.empty()) {
+				std::ofstream file(this->path, std::ios::binary | std::ios::app);
+				writeEntry(file, key, stored);
+			}
+		}
+
+		//----------
+		size_t size() const {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			return this->entries.size();
+		}
+
+		//----------
+		size_t getHitCount() const {
+			return this->hitCount;
+		}
+
+		//----------
+		size_t getMissCount() const {
+			return this->missCount;
+		}
+
+	protected:
+		struct Stored {
+			std::vector<double> parameters;
+			SummaryRecord summary;
+			std::string message;
+		};
+
+		//----------
+		static const char * getMagic() {
+			return "ofxCSCch";
+		}
+
+		//----------
+		static size_t alignTo8(size_t offset) {
+			return (offset + 7) & ~(size_t) 7;
+		}
+
+		//----------
+		static uint64_t getChecksum(Entry entry, const void * parameters, const char * message) {
+			entry.checksum = 0;
+			Fingerprint fingerprint;
+			fingerprint.add(entry);
+			fingerprint.add(parameters, (size_t) entry.parameterCount * sizeof(double));
+			fingerprint.add(message, entry.messageSize);
+			return fingerprint.get();
+		}
+
+		//----------
+		static void writeEntry(std::ostream & file, uint64_t key, const Stored & stored) {
+			Entry entry;
+			std::memset(&entry, 0, sizeof(entry));
+			entry.key = key;
+			entry.parameterCount = (uint32_t) stored.parameters.size();
+			entry.messageSize = (uint32_t) stored.message.size();
+			entry.summary = stored.summary;
+			entry.checksum = getChecksum(entry, stored.parameters.data(), stored.message.data());
+
+			file.write((const char *) &entry, sizeof(entry));
+			file.write((const char *) stored.parameters.data(), stored.parameters.size() * sizeof(double));
+			file.write(stored.message.data(), stored.message.size());
+			const char padding[8] = { 0 };
+			file.write(padding, alignTo8(stored.message.size()) - stored.message.size());
+		}
+
+		//----------
+		// False for a missing or incompatible file. Otherwise validSize is the end of
+		// the last intact entry, short of fileSize when the rest is damaged.
+		bool loadFile(const std::string & path, size_t & validSize, size_t & fileSize) {
+			std::ifstream file(path, std::ios::binary);
+			if (!file) {
+				return false;
+			}
+			const std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			fileSize = data.size();
+
+			Header header;
+			if (data.size() < sizeof(Header)) {
+				return false;
+			}
+			std::memcpy(&header, data.data(), sizeof(Header));
+			if (std::memcmp(header.magic, getMagic(), sizeof(header.magic)) != 0
+				|| header.versionMajor != VersionMajor
+				|| header.headerSize < sizeof(Header)
+				|| header.headerSize % 8 != 0) {
+				return false;
+			}
+
+			size_t offset = header.headerSize;
+			while (offset + sizeof(Entry) <= data.size()) {
+				Entry entry;
+				std::memcpy(&entry, data.data() + offset, sizeof(Entry));
+				const size_t parametersOffset = offset + sizeof(Entry);
+				const size_t messageOffset = parametersOffset + (size_t) entry.parameterCount * sizeof(double);
+				const size_t nextOffset = messageOffset + alignTo8(entry.messageSize);
+				if (nextOffset > data.size()
+					|| entry.checksum != getChecksum(entry
+						, data.data() + parametersOffset
+						, data.data() + messageOffset)) {
+					break;
+				}
+
+				auto & stored = this->entries[entry.key];
+				stored.parameters.resize(entry.parameterCount);
+				std::memcpy(stored.parameters.data(), data.data() + parametersOffset, stored.parameters.size() * sizeof(double));
+				stored.message.assign(data.data() + messageOffset, entry.messageSize);
+				stored.summary = entry.summary;
+				offset = nextOffset;
+			}
+			validSize = offset;
+			return true;
+		}
+
+		//----------
+		bool saveFile(const std::string & path) const {
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			if (!file) {
+				return false;
+			}
+
+			Header header;
+			std::memset(&header, 0, sizeof(header));
+			std::memcpy(header.magic, getMagic(), sizeof(header.magic));
+			header.versionMajor = VersionMajor;
+			header.versionMinor = VersionMinor;
+			header.headerSize = sizeof(Header);
+			file.write((const char *) &header, sizeof(header));
+
+			for (const auto & entry : this->entries) {
+				writeEntry(file, entry.first, entry.second);
+			}
+			return (bool) file;
+		}
+
+		mutable std::mutex mutex;
+		std::unordered_map<uint64_t, Stored> entries;
+		std::string path;
+		std::atomic<size_t> hitCount{ 0 };
+		std::atomic<size_t> missCount{ 0 };
+	};
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ofxCeresSolver {
+	//----------
+	// Persistent worker threads for the addon's parallel loops, so per-frame
+	// work does not pay thread creation every call.
+	// The calling thread always takes part in parallelFor and runs queued tasks
+	// while it waits, so parallelFor may be nested inside a task.
+	class ThreadPool {
+	public:
+		//----------
+		// numThreads counts the calling thread. 0 = hardware concurrency.
+		explicit ThreadPool(int numThreads = 0) {
+			if (numThreads <= 0) {
+				numThreads = std::max(1, (int) std::thread::hardware_concurrency());
+			}
+			for (int i = 1; i < numThreads; i++) {
+				this->workers.emplace_back([this]() {
+					this->workerLoop();
+				});
+			}
+		}
+
+		//----------
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->stopping = true;
+			}
+			this->taskAvailable.notify_all();
+			for (auto & worker : this->workers) {
+				worker.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool & operator=(const ThreadPool &) = delete;
+
+		//----------
+		int getNumThreads() const {
+			return (int) this->workers.size() + 1;
+		}
+
+		//----------
+		// Calls function(index) for every index in [0, count).
+		template<typename Function>
+		void parallelFor(size_t count, const Function & function) {
+			this->parallelForChunked(count, [&function](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					function(i);
+				}
+			});
+		}
+
+		//----------
+		// Calls function(begin, end) over disjoint ranges covering [0, count).
+		// Use this when each chunk wants its own scratch memory.
+		template<typename Function>
+		void parallelForChunked(size_t count, const Function & function) {
+			if (count == 0) {
+				return;
+			}
+
+			const size_t numThreads = (size_t) this->getNumThreads();
+			if (numThreads == 1 || count == 1) {
+				function((size_t) 0, count);
+				return;
+			}
+
+			// a few chunks per thread to balance uneven work
+			const size_t chunkSize = std::max((size_t) 1, count / (numThreads * 4));
+			std::atomic<size_t> next(0);
+			auto run = [&]() {
+				size_t begin;
+				while ((begin = next.fetch_add(chunkSize)) < count) {
+					function(begin, std::min(begin + chunkSize, count));
+				}
+			};
+
+			const size_t numHelpers = std::min(numThreads - 1, (count + chunkSize - 1) / chunkSize - 1);
+			std::atomic<size_t> remaining(numHelpers);
+			for (size_t i = 0; i < numHelpers; i++) {
+				this->enqueue([&run, &remaining]() {
+					run();
+					remaining--;
+				});
+			}
+
+			run();
+			this->waitFor(remaining);
+		}
+
+		//----------
+		// Queue a task without waiting for it. Pair with waitFor or your own
+		// synchronisation.
+		void enqueue(std::function<void()> task) {
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->tasks.push_back(std::move(task));
+			}
+			this->taskAvailable.notify_one();
+		}
+
+		//----------
+		// Run queued tasks on the calling thread until counter reaches 0.
+		void waitFor(const std::atomic<size_t> & counter) {
+			while (counter.load() > 0) {
+				std::function<void()> task;
+				{
+					std::lock_guard<std::mutex> lock(this->mutex);
+					if (!this->tasks.empty()) {
+						task = std::move(this->tasks.front());
+						this->tasks.pop_front();
+					}
+				}
+				if (task) {
+					task();
+				}
+				else {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		//----------
+		// Process-wide pool shared by the addon's solvers by default.
+		static ThreadPool & getShared() {
+			static ThreadPool pool;
+			return pool;
+		}
+
+	protected:
+		//----------
+		void workerLoop() {
+			while (true) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(this->mutex);
+					this->taskAvailable.wait(lock, [this]() {
+						return this->stopping || !this->tasks.empty();
+					});
+					if (this->tasks.empty()) {
+						return;
+					}
+					task = std::move(this->tasks.front());
+					this->tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable taskAvailable;
+		bool stopping = false;
+	};
+}
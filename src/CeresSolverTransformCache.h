@@ -0,0 +1,190 @@
+#pragma once
+
+#include "ofxCeresSolver.h"
+
+#include <ceres/evaluation_callback.h>
+
+#include <deque>
+
+namespace ofxCeresSolver {
+	//----------
+	// Transforms of shared 6 parameter blocks (translation, euler rotation),
+	// computed once per evaluation point instead of once per residual block.
+	// Set it as the solver's evaluation_callback: ceres then writes each trial
+	// point into the parameter blocks and calls PrepareForEvaluation before
+	// evaluating any residuals, which rebuilds every cached transform together
+	// with its derivatives with respect to the 6 parameters.
+	//
+	//	SharedTransformCache cache;
+	//	auto & entry = cache.add(parameters);
+	//	problem.AddResidualBlock(CachedRigidBodyTransformError::Create(entry, a, b), NULL, parameters);
+	//	cache.attach(options);
+	//	ceres::Solve(options, &problem, &summary);
+	class SharedTransformCache : public ceres::EvaluationCallback {
+	public:
+		typedef ceres::Jet<double, 6> JetType;
+
+		struct Entry {
+			const double * parameters;
+			double values[6]; // parameters at which transform was computed
+			VectorMath::Affine<JetType> transform;
+
+			//----------
+			// Cost functions fall back to computing the transform themselves when
+			// evaluated elsewhere, e.g. Problem::Evaluate or ceres::Covariance.
+			bool matches(const double * parameters) const {
+				for (int i = 0; i < 6; i++) {
+					if (parameters[i] != this->values[i]) {
+						return false;
+					}
+				}
+				return true;
+			}
+		};
+
+		//----------
+		// The entry stays valid for the lifetime of the cache
+		const Entry & add(const double * parameters) {
+			this->entries.emplace_back();
+			auto & entry = this->entries.back();
+			entry.parameters = parameters;
+			update(entry);
+			return entry;
+		}
+
+		//----------
+		void attach(ceres::Solver::Options & options) {
+			options.evaluation_callback = this;
+		}
+
+		//----------
+		void PrepareForEvaluation(bool /*evaluateJacobians*/, bool newEvaluationPoint) override {
+			if (!newEvaluationPoint) {
+				return;
+			}
+			for (auto & entry : this->entries) {
+				update(entry);
+			}
+		}
+
+		//----------
+		static VectorMath::Affine<JetType> computeTransform(const double * parameters) {
+			glm::tvec3<JetType> translation(JetType(parameters[0], 0), JetType(parameters[1], 1), JetType(parameters[2], 2));
+			glm::tvec3<JetType> rotationVector(JetType(parameters[3], 3), JetType(parameters[4], 4), JetType(parameters[5], 5));
+			return VectorMath::createAffineTransform(translation, rotationVector);
+		}
+
+	protected:
+		//----------
+		static void update(Entry & entry) {
+			std::copy(entry.parameters, entry.parameters + 6, entry.values);
+			entry.transform = computeTransform(entry.parameters);
+		}
+
+		std::deque<Entry> entries; // stable addresses
+	};
+
+	//----------
+	// RigidBodyTransformError reading its transform from a SharedTransformCache.
+	// Per residual block only the point product remains (9 multiply-adds on
+	// 6 derivatives), with no trig or matrix construction.
+	class CachedRigidBodyTransformError : public ceres::SizedCostFunction<3, 6> {
+	public:
+		CachedRigidBodyTransformError(const SharedTransformCache::Entry & cache
+			, const glm::tvec3<double> & untransformedPoint
+			, const glm::tvec3<double> & transformedPoint)
+			: cache(cache)
+			, untransformedPoint(untransformedPoint)
+			, transformedPoint(transformedPoint) {}
+
+		//----------
+		bool Evaluate(double const * const * parameters
+			, double * residuals
+			, double ** jacobians) const override {
+			VectorMath::Affine<SharedTransformCache::JetType> localTransform;
+			const auto * transform = &this->cache.transform;
+			if (!this->cache.matches(parameters[0])) {
+				localTransform = SharedTransformCache::computeTransform(parameters[0]);
+				transform = &localTransform;
+			}
+
+			const auto predictedTransformedPoint = transform->transformPoint(this->untransformedPoint);
+			for (int i = 0; i < 3; i++) {
+				residuals[i] = this->transformedPoint[i] - predictedTransformedPoint[i].a;
+			}
+			if (jacobians && jacobians[0]) {
+				for (int i = 0; i < 3; i++) {
+					for (int j = 0; j < 6; j++) {
+						jacobians[0][i * 6 + j] = -predictedTransformedPoint[i].v[j];
+					}
+				}
+			}
+			return true;
+		}
+
+		//----------
+		static ceres::CostFunction * Create(const SharedTransformCache::Entry & cache
+			, const glm::tvec3<double> & untransformedPoint
+			, const glm::tvec3<double> & transformedPoint) {
+			return new CachedRigidBodyTransformError(cache, untransformedPoint, transformedPoint);
+		}
+
+		const SharedTransformCache::Entry & cache;
+		glm::tvec3<double> untransformedPoint;
+		glm::tvec3<double> transformedPoint;
+	};
+
+	//----------
+	// PointToPlaneTransformError reading its transform from a SharedTransformCache.
+	class CachedPointToPlaneTransformError : public ceres::SizedCostFunction<1, 6> {
+	public:
+		CachedPointToPlaneTransformError(const SharedTransformCache::Entry & cache
+			, const glm::tvec3<double> & untransformedPoint
+			, const glm::tvec3<double> & transformedPoint
+			, const glm::tvec3<double> & transformedNormal)
+			: cache(cache)
+			, untransformedPoint(untransformedPoint)
+			, transformedPoint(transformedPoint)
+			, transformedNormal(transformedNormal) {}
+
+		//----------
+		bool Evaluate(double const * const * parameters
+			, double * residuals
+			, double ** jacobians) const override {
+			VectorMath::Affine<SharedTransformCache::JetType> localTransform;
+			const auto * transform = &this->cache.transform;
+			if (!this->cache.matches(parameters[0])) {
+				localTransform = SharedTransformCache::computeTransform(parameters[0]);
+				transform = &localTransform;
+			}
+
+			const auto predictedTransformedPoint = transform->transformPoint(this->untransformedPoint);
+			residuals[0] = 0.0;
+			for (int i = 0; i < 3; i++) {
+				residuals[0] += (this->transformedPoint[i] - predictedTransformedPoint[i].a) * this->transformedNormal[i];
+			}
+			if (jacobians && jacobians[0]) {
+				for (int j = 0; j < 6; j++) {
+					jacobians[0][j] = 0.0;
+					for (int i = 0; i < 3; i++) {
+						jacobians[0][j] -= predictedTransformedPoint[i].v[j] * this->transformedNormal[i];
+					}
+				}
+			}
+			return true;
+		}
+
+		//----------
+		static ceres::CostFunction * Create(const SharedTransformCache::Entry & cache
+			, const glm::tvec3<double> & untransformedPoint
+			, const glm::tvec3<double> & transformedPoint
+			, const glm::tvec3<double> & transformedNormal) {
+			return new CachedPointToPlaneTransformError(cache, untransformedPoint, transformedPoint, transformedNormal);
+		}
+
+		const SharedTransformCache::Entry & cache;
+		glm::tvec3<double> untransformedPoint;
+		glm::tvec3<double> transformedPoint;
+		glm::tvec3<double> transformedNormal;
+	};
+}
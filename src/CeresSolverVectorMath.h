@@ -2,6 +2,7 @@
 // reffered from
 // https://github.com/elliotwoods/ofxCeres
 #include "ofVectorMath.h"
+#include "CeresSolverJetKernels.h"
 
 #include <utility>
 
@@ -91,13 +92,107 @@ namespace ofxCeresSolver {
 			return result;
 		}
 
+		//----------
+		// Transform stored as the top 3 rows of a 4x4 matrix (column major like glm).
+		// The bottom row of a rigid or affine transform is always (0, 0, 0, 1), so
+		// composing and applying these skips the products a full glm::tmat4x4 spends
+		// on it, and accumulates with JetKernels::multiplyAdd.
+		template<typename T>
+		struct Affine {
+			typedef typename JetKernels::ScalarType<T>::type Scalar;
+
+			Affine() {}
+
+			//----------
+			template<typename S>
+			explicit Affine(const glm::tmat4x4<S> & matrix) {
+				for (int column = 0; column < 4; column++) {
+					for (int row = 0; row < 3; row++) {
+						this->columns[column][row] = T(matrix[column][row]);
+					}
+				}
+			}
+
+			//----------
+			// point with w = 1
+			glm::tvec3<T> transformPoint(const glm::tvec3<T> & point) const {
+				glm::tvec3<T> result = this->columns[3];
+				for (int row = 0; row < 3; row++) {
+					for (int column = 0; column < 3; column++) {
+						JetKernels::multiplyAdd(result[row], this->columns[column][row], point[column]);
+					}
+				}
+				return result;
+			}
+
+			//----------
+			// constant point, e.g. data held by a cost functor
+			template<typename S>
+			glm::tvec3<T> transformPoint(const glm::tvec3<S> & point) const {
+				glm::tvec3<T> result = this->columns[3];
+				for (int row = 0; row < 3; row++) {
+					for (int column = 0; column < 3; column++) {
+						JetKernels::multiplyAdd(result[row], this->columns[column][row], (Scalar) point[column]);
+					}
+				}
+				return result;
+			}
+
+			//----------
+			Affine operator*(const Affine & other) const {
+				Affine result;
+				for (int column = 0; column < 4; column++) {
+					result.columns[column] = column == 3
+						? this->columns[3]
+						: glm::tvec3<T>(T(0.0), T(0.0), T(0.0));
+					for (int row = 0; row < 3; row++) {
+						for (int i = 0; i < 3; i++) {
+							JetKernels::multiplyAdd(result.columns[column][row], this->columns[i][row], other.columns[column][i]);
+						}
+					}
+				}
+				return result;
+			}
+
+			//----------
+			glm::tmat4x4<T> toMat4() const {
+				glm::tmat4x4<T> matrix;
+				for (int column = 0; column < 4; column++) {
+					for (int row = 0; row < 3; row++) {
+						matrix[column][row] = this->columns[column][row];
+					}
+					matrix[column][3] = T(column == 3 ? 1.0 : 0.0);
+				}
+				return matrix;
+			}
+
+			glm::tvec3<T> columns[4]; // x, y, z axes then translation
+		};
+
+		//----------
+		// translate(translation) * rotate(rotationVector) without the 4x4 product
+		template<typename T>
+		Affine<T> createAffineTransform(const glm::tvec3<T> & translation, const glm::tvec3<T> & rotationVector) {
+			const auto q = eulerToQuat(rotationVector);
+
+			const T xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+			const T xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+			const T wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+			// same as the glm quaternion to matrix cast
+			Affine<T> transform;
+			transform.columns[0] = glm::tvec3<T>(T(1.0) - T(2.0) * (yy + zz), T(2.0) * (xy + wz), T(2.0) * (xz - wy));
+			transform.columns[1] = glm::tvec3<T>(T(2.0) * (xy - wz), T(1.0) - T(2.0) * (xx + zz), T(2.0) * (yz + wx));
+			transform.columns[2] = glm::tvec3<T>(T(2.0) * (xz + wy), T(2.0) * (yz - wx), T(1.0) - T(2.0) * (xx + yy));
+			transform.columns[3] = translation;
+			return transform;
+		}
+
 		//----------
 		template<typename T>
 		glm::tmat4x4<T> createTransform(const glm::tvec3<T> & translation, const glm::tvec3<T> & rotationVector)
 		{
-			auto rotationQuat = eulerToQuat(rotationVector);
-			auto rotationMat = glm::tmat4x4<T>(rotationQuat);
-			return glm::translate(translation) * rotationMat;
+			return createAffineTransform(translation, rotationVector).toMat4();
 		}
 
 		//----------
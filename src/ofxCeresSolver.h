@@ -13,3 +13,30 @@ namespace std {
 }
 
 #include <glm/glm.hpp>
+
+#include "CeresSolverThreadPool.h"
+#include "CeresSolverCostFunctions.h"
+#include "CeresSolverKdTree.h"
+#include "CeresSolverICP.h"
+#include "CeresSolverRigidBodyTracker.h"
+#include "CeresSolverIK.h"
+#include "CeresSolverHomography.h"
+#include "CeresSolverImageAlignment.h"
+#include "CeresSolverCovariance.h"
+#include "CeresSolverSnapshot.h"
+#include "CeresSolverPointStream.h"
+#include "CeresSolverProgressiveSampling.h"
+#include "CeresSolverProblemBuilder.h"
+#include "CeresSolverPresets.h"
+#include "CeresSolverPreallocatedAutoDiff.h"
+#include "CeresSolverProfiler.h"
+#include "CeresSolverSlidingWindow.h"
+#include "CeresSolverTransformCache.h"
+#include "CeresSolverParallelNumericDiff.h"
+#include "CeresSolverLockstepTinySolver.h"
+#include "CeresSolverSignedDistanceField.h"
+#include "CeresSolverContourFitting.h"
+#include "CeresSolverDecomposition.h"
+#include "CeresSolverMultiStart.h"
+#include "CeresSolverPoseGraph.h"
+#include "CeresSolverSolveCache.h"